@@ -0,0 +1,956 @@
+#include "bench.h"
+#include "Visitor.h"
+#include "Observer.h"
+#include "Movement.h"
+#include "VariantCombat.h"
+#include "Streaming.h"
+#include "KdTree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static std::atomic<size_t> allocations{0};
+
+static void* counted_alloc(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+static void* counted_alloc(size_t size, std::align_val_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t alignment = static_cast<size_t>(align);
+    // aligned_alloc wants a multiple of the alignment
+    size_t rounded = (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment;
+    if (void* p = std::aligned_alloc(alignment, rounded)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// Every replaceable form, so that nothing bypasses the counter and each
+// delete matches its new.
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void* operator new(size_t size, std::align_val_t align) { return counted_alloc(size, align); }
+void* operator new[](size_t size, std::align_val_t align) { return counted_alloc(size, align); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+// Allocations of one warmed-up round; what remains scales with kills
+// (event strings, cleanup), not with the number of pairs tested.
+static void bench_combat_allocations(size_t count) {
+    for (double rad : {2.0, 10.0}) {
+        NPC_array arr;
+        make_uniform_world(arr, count, 1);
+        CombatVisitor combat;
+        combat.do_combat(arr, rad);  // warm up reusable buffers
+        NPC_array round;
+        make_uniform_world(round, count, 2);
+        size_t before_kills = round.get_size();
+        size_t before = allocations.load();
+        combat.do_combat(round, rad);
+        size_t allocs = allocations.load() - before;
+        size_t kills = before_kills - round.get_size();
+        printf("%-28s n=%-9zu rad=%-5.1f %10zu allocs %8zu kills\n", "combat/allocations",
+               count, rad, allocs, kills);
+        record({"combat/allocations", {{"n", std::to_string(count)}, {"radius", param(rad)}},
+                {{"allocs", double(allocs)}, {"kills", double(kills)}}});
+    }
+}
+
+static void bench_combat_scaling(size_t max_count) {
+    const double rad = 2.0;
+    for (size_t n : {1000, 4000, 16000, 64000, 250000, 1000000}) {
+        if (n > max_count) {
+            break;
+        }
+        if (n <= 16000) {
+            NPC_array arr;
+            make_uniform_world(arr, n, 1);
+            CombatVisitor combat;
+            combat.set_use_grid(false);
+            report("combat/brute_force", n, time_ms([&] { combat.do_combat(arr, rad); }));
+        }
+        NPC_array arr;
+        make_uniform_world(arr, n, 1);
+        CombatVisitor combat;
+        report("combat/grid", n, time_ms([&] { combat.do_combat(arr, rad); }));
+    }
+}
+
+static void bench_range_kernels() {
+    const size_t targets = 1 << 16;
+    const size_t attackers = 2000;
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    std::vector<double> xs(targets), ys(targets), ax(attackers), ay(attackers);
+    for (size_t i = 0; i < targets; ++i) {
+        xs[i] = coord(gen);
+        ys[i] = coord(gen);
+    }
+    for (size_t i = 0; i < attackers; ++i) {
+        ax[i] = coord(gen);
+        ay[i] = coord(gen);
+    }
+    std::pair<const char*, RangeKernel> kernels[] = {
+        {"range_kernel/scalar", range_mask_scalar},
+#ifdef NPC_SIMD_X86
+        {"range_kernel/sse2", range_mask_sse2},
+        {"range_kernel/avx2", __builtin_cpu_supports("avx2") ? range_mask_avx2 : nullptr},
+#endif
+        {"range_kernel/selected", select_range_kernel()},
+    };
+    for (auto& [label, kernel] : kernels) {
+        if (!kernel) {
+            continue;
+        }
+        size_t hits = 0;
+        double ms = time_ms([&] {
+            for (size_t a = 0; a < attackers; ++a) {
+                for (size_t k = 0; k < targets; k += RANGE_BLOCK) {
+                    hits += __builtin_popcount(kernel(ax[a], ay[a], xs.data() + k, ys.data() + k,
+                                                      RANGE_BLOCK, 50.0 * 50.0));
+                }
+            }
+        });
+        report(label, attackers * targets, ms);
+        if (hits == 0) {
+            printf("unexpected: no hits\n");
+        }
+    }
+}
+
+static void bench_combat_threads(size_t count) {
+    size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= hw; threads *= 2) {
+        NPC_array arr;
+        make_uniform_world(arr, count, 1);
+        CombatVisitor combat(threads);
+        std::string label = "combat/threads=" + std::to_string(threads);
+        report(label.c_str(), count, time_ms([&] { combat.do_combat(arr, 2.0); }));
+    }
+}
+
+// Ticks in which 1% of the NPCs jump to a new spot before combat.
+static void bench_combat_ticks(size_t count) {
+    const int ticks = 5;
+    for (bool incremental : {false, true}) {
+        NPC_array arr;
+        make_uniform_world_pooled(arr, count, 1);
+        CombatVisitor combat;
+        combat.set_incremental(incremental);
+        combat.do_combat(arr, 2.0);
+        std::mt19937 gen(3);
+        std::uniform_real_distribution<double> coord(0.0, 500.0);
+        double ms = 0;
+        for (int tick = 0; tick < ticks; ++tick) {
+            auto& npcs = arr.get_npcs();
+            for (size_t k = 0; k < npcs.size() / 100; ++k) {
+                NPC& npc = *npcs[gen() % npcs.size()];
+                npc.set_x(coord(gen));
+                npc.set_y(coord(gen));
+            }
+            ms += time_ms([&] { combat.do_combat(arr, 2.0); });
+        }
+        report(incremental ? "ticks/incremental" : "ticks/full", count, ms / ticks);
+    }
+}
+
+// Per-phase breakdown of a few moving rounds; needs the bench_stats build.
+// Running the same group in both builds shows what collecting costs.
+static void bench_stats(size_t count) {
+    const int ticks = 5;
+    NPC_array arr;
+    make_uniform_world_pooled(arr, count, 1);
+    CombatVisitor combat;
+    combat.set_incremental(true);
+    combat.set_movement(std::make_unique<MovementStage>(9));
+    combat.add_observer(std::make_unique<StatsObserver>(stdout));
+    double ms = time_ms([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            combat.do_combat(arr, 2.0);
+        }
+    });
+    report(STATS_ENABLED ? "stats/rounds (on)" : "stats/rounds (off)", count, ms / ticks);
+}
+
+// Stands in for Display: formats and flushes every event.
+class FlushingSink : public Observer {
+    public:
+        FlushingSink() : out(fopen("/dev/null", "w")) {}
+        ~FlushingSink() { fclose(out); }
+        void update(const std::string& event) override {
+            fprintf(out, "%s\n", event.c_str());
+            fflush(out);
+        }
+    private:
+        FILE* out;
+};
+
+// Combat with a file logger and a flushing sink attached, delivered on
+// the combat thread or through the event bus; drain is the time the bus
+// observers still need after do_combat returned.
+static void bench_event_bus(size_t count) {
+    const char* path = "bench_bus.log";
+    for (bool bus : {false, true}) {
+        std::remove(path);
+        NPC_array arr;
+        make_uniform_world_pooled(arr, count, 1);
+        CombatVisitor combat;
+        combat.set_event_bus(bus);
+        combat.add_observer(std::make_unique<FileLogger>(path));
+        combat.add_observer(std::make_unique<FlushingSink>());
+        size_t before = arr.get_size();
+        double ms = time_ms([&] { combat.do_combat(arr, 2.0); });
+        double drain = time_ms([&] { combat.flush_observers(); });
+        size_t kills = before - arr.get_size();
+        const char* label = bus ? "observers/bus" : "observers/sync";
+        printf("%-28s n=%-9zu combat %10.2f ms  drain %10.2f ms  %8zu events\n", label, count, ms, drain, kills);
+        record({label, {{"n", std::to_string(count)}}, {{"combat_ms", ms}, {"drain_ms", drain}, {"events", double(kills)}}});
+    }
+    std::remove(path);
+}
+
+// One round with the default three kinds against 48 config kinds whose
+// rules kill as often; the pair check is one matrix load either way.
+static void bench_rules(size_t count) {
+    KillRules saved = active_rules();
+    std::string config;
+    for (int k = 0; k < 48; ++k) {
+        config += "kind k" + std::to_string(k) + "\n";
+    }
+    std::mt19937 gen(8);
+    for (int a = 0; a < 48; ++a) {
+        config += "k" + std::to_string(a) + " kills";
+        for (int t = 0; t < 48; ++t) {
+            if (gen() % 3 == 0) {
+                config += " k" + std::to_string(t);
+            }
+        }
+        config += "\n";
+    }
+    for (bool many : {false, true}) {
+        active_rules() = many ? KillRules::parse(config) : saved;
+        NPC_array arr;
+        std::mt19937 world(1);
+        std::uniform_real_distribution<double> coord(0.0, WORLD_SIZE);
+        for (size_t i = 0; i < count; ++i) {
+            size_t kind = many ? NPC_KIND_COUNT + world() % 48 : 1 + world() % 3;
+            double x = coord(world);
+            arr.emplace_npc(static_cast<NPCKind>(kind), "npc", x, coord(world));
+        }
+        CombatVisitor combat;
+        size_t before = arr.get_size();
+        double ms = time_ms([&] { combat.do_combat(arr, 2.0); });
+        const char* label = many ? "rules/48_kinds" : "rules/default";
+        printf("%-28s n=%-9zu %10.2f ms %10zu kills\n", label, count, ms, before - arr.get_size());
+        record({label, {{"n", std::to_string(count)}, {"radius", "2"}}, {{"ms", ms}, {"kills", double(before - arr.get_size())}}});
+    }
+    active_rules() = saved;
+}
+
+// k-d tree against brute force on uniform and clustered worlds: radius
+// and k-nearest queries from NPC positions, then a round in which every
+// kind has its own attack radius. Brute force is capped at 20k NPCs.
+static void bench_kdtree(size_t count) {
+    const size_t brute_max = 20000;
+    for (bool clustered : {false, true}) {
+        WorldSpec spec;
+        spec.count = count;
+        spec.clustered = clustered;
+        std::vector<double> xs, ys;
+        generate_world(spec, [&](NPCKind, std::string_view, double x, double y) {
+            xs.push_back(x);
+            ys.push_back(y);
+        });
+        std::string dist = clustered ? "clustered" : "uniform";
+        KdTree tree;
+        double build_ms = time_ms([&] { tree.build(xs.data(), ys.data(), count); });
+        printf("%-28s n=%-9zu %10.2f ms\n", ("kdtree/build/" + dist).c_str(), count, build_ms);
+        record({"kdtree/build", {{"n", std::to_string(count)}, {"dist", dist}}, {{"ms", build_ms}}});
+
+        size_t queries = std::min<size_t>(count, 100000);
+        size_t found = 0;
+        double tree_ms = time_ms([&] {
+            for (size_t q = 0; q < queries; ++q) {
+                tree.for_each_in_radius(xs[q], ys[q], 2.0, [&](uint32_t) { ++found; });
+            }
+        });
+        size_t brute_queries = std::min<size_t>(queries, brute_max * brute_max / count);
+        size_t brute_found = 0;
+        double brute_ms = time_ms([&] {
+            for (size_t q = 0; q < brute_queries; ++q) {
+                for (size_t i = 0; i < count; ++i) {
+                    double dx = xs[q] - xs[i];
+                    double dy = ys[q] - ys[i];
+                    brute_found += dx * dx + dy * dy <= 4.0;
+                }
+            }
+        });
+        std::vector<uint32_t> nearest;
+        double knn_ms = time_ms([&] {
+            for (size_t q = 0; q < queries; ++q) {
+                tree.nearest(xs[q], ys[q], 8, nearest);
+            }
+        });
+        size_t prefix_found = 0;
+        for (size_t q = 0; q < brute_queries; ++q) {
+            tree.for_each_in_radius(xs[q], ys[q], 2.0, [&](uint32_t) { ++prefix_found; });
+        }
+        if (prefix_found != brute_found) {
+            printf("unexpected: tree found %zu, brute force %zu\n", prefix_found, brute_found);
+        }
+        double tree_us = 1000 * tree_ms / queries;
+        double brute_us = 1000 * brute_ms / brute_queries;
+        double knn_us = 1000 * knn_ms / queries;
+        printf("%-28s n=%-9zu radius 2: tree %8.3f us  brute %10.3f us  knn8 %8.3f us  (%.1f hits)\n",
+               ("kdtree/query/" + dist).c_str(), count, tree_us, brute_us, knn_us, double(found) / queries);
+        record({"kdtree/query", {{"n", std::to_string(count)}, {"dist", dist}, {"radius", "2"}, {"k", "8"}},
+                {{"tree_us", tree_us}, {"brute_us", brute_us}, {"knn_us", knn_us}, {"hits", double(found) / queries}}});
+
+        size_t small = std::min(count, brute_max);
+        std::vector<std::pair<bool, size_t>> runs = {{true, small}, {false, small}};
+        if (count > small) {
+            runs.emplace_back(false, count);
+        }
+        for (auto [brute, n] : runs) {
+            NPC_array world;
+            world.reserve(n);
+            WorldSpec part = spec;
+            part.count = n;
+            generate_world(part, [&](NPCKind kind, std::string_view name, double x, double y) {
+                world.emplace_npc(kind, name, x, y);
+            });
+            CombatVisitor combat;
+            combat.set_use_grid(!brute);
+            combat.set_kind_radius(NPCKind::squirrel, 1.0);
+            combat.set_kind_radius(NPCKind::werewolf, 4.0);
+            double ms = time_ms([&] { combat.do_combat(world, 2.0); });
+            std::string label = (brute ? "kdtree/combat_brute/" : "kdtree/combat_tree/") + dist;
+            printf("%-28s n=%-9zu %10.2f ms %10zu kills\n", label.c_str(), n, ms, n - world.get_size());
+            record({brute ? "kdtree/combat_brute" : "kdtree/combat_tree",
+                    {{"n", std::to_string(n)}, {"dist", dist}, {"radii", "1:4:2"}},
+                    {{"ms", ms}, {"kills", double(n - world.get_size())}}});
+        }
+    }
+}
+
+// Same world and round through virtual visit_* calls on NPC_array and
+// through std::visit on a vector of NPCVariant.
+static void bench_dispatch(size_t count) {
+    for (double rad : {2.0, 10.0}) {
+        std::string suffix = rad < 5 ? "/rad=2" : "/rad=10";
+        // a wide radius tests ~25x more pairs
+        size_t n = rad < 5 ? count : std::min<size_t>(count, 100000);
+        NPC_array arr;
+        make_uniform_world_pooled(arr, n, 1);
+        std::vector<NPCVariant> values = to_variants(arr);
+        CombatVisitor combat;
+        std::string label = "dispatch/virtual" + suffix;
+        report(label.c_str(), n, time_ms([&] { combat.do_combat(arr, rad); }));
+        VariantCombatVisitor variant;
+        label = "dispatch/variant" + suffix;
+        report(label.c_str(), n, time_ms([&] { variant.do_combat(values, rad); }));
+        if (values.size() != arr.get_size()) {
+            printf("unexpected: %zu vs %zu survivors\n", values.size(), arr.get_size());
+        }
+    }
+}
+
+static void kill_fraction(NPC_array& arr, double rate, std::vector<std::string>* names) {
+    std::mt19937 gen(5);
+    std::bernoulli_distribution dies(rate);
+    for (auto& npc : arr.get_npcs()) {
+        if (dies(gen)) {
+            npc->kill_npc();
+            if (names) {
+                names->emplace_back(npc->get_name());
+            }
+        }
+    }
+}
+
+static void bench_cleanup(size_t max_count) {
+    for (double rate : {0.1, 0.5}) {
+        std::string suffix = rate < 0.2 ? "/kill=10%" : "/kill=50%";
+        // the per-name scan is quadratic, keep it small
+        size_t small = std::min<size_t>(max_count, 20000);
+        {
+            NPC_array arr;
+            make_uniform_world(arr, small, 1);
+            std::vector<std::string> names;
+            kill_fraction(arr, rate, &names);
+            std::string label = "cleanup/remove_npc" + suffix;
+            report(label.c_str(), small, time_ms([&] {
+                for (auto& name : names) {
+                    arr.remove_npc(name);
+                }
+            }));
+        }
+        for (size_t n : {small, max_count}) {
+            NPC_array arr;
+            make_uniform_world(arr, n, 1);
+            kill_fraction(arr, rate, nullptr);
+            std::string label = "cleanup/erase_dead" + suffix;
+            report(label.c_str(), n, time_ms([&] { arr.erase_dead(); }));
+        }
+    }
+}
+
+static void bench_loggers(size_t events) {
+    const char* path = "bench_log.txt";
+    std::string event = "NPC werewolf npc123456 убит. Убийца: squirrel npc654321.";
+    auto run = [&](const char* label, Observer& logger, auto&& finish) {
+        double ms = time_ms([&] {
+            for (size_t i = 0; i < events; ++i) {
+                logger.update(event);
+            }
+            finish();
+        });
+        printf("%-28s n=%-9zu %10.2f ms %12.0f events/s\n", label, events, ms, events / ms * 1000.0);
+        record({label, {{"n", std::to_string(events)}}, {{"ms", ms}, {"events_per_s", events / ms * 1000.0}}});
+    };
+    {
+        std::remove(path);
+        FileLogger logger(path);
+        run("logger/file_sync", logger, [] {});
+    }
+    for (auto policy : {OverflowPolicy::block, OverflowPolicy::drop}) {
+        std::remove(path);
+        AsyncFileLogger logger(path, 65536, std::chrono::milliseconds(100), policy);
+        run(policy == OverflowPolicy::block ? "logger/async_block" : "logger/async_drop",
+            logger, [&] { logger.flush(); });
+        if (logger.get_dropped()) {
+            printf("%-28s dropped %llu\n", "", static_cast<unsigned long long>(logger.get_dropped()));
+        }
+    }
+    std::remove(path);
+}
+
+static void bench_loaders(size_t count) {
+    const char* path = "bench_world.txt";
+    write_world_file(path, count, 11);
+    size_t bytes = file_size(path);
+    {
+        NPC_array arr;
+        report_throughput("load/fscanf", count,
+                          time_ms([&] { NPCFactory::load_from_file_c_style(path, arr); }), bytes);
+    }
+    {
+        NPC_array arr;
+        report_throughput("load/mmap", count,
+                          time_ms([&] { NPCFactory::load_from_file_mmap(path, arr); }), bytes);
+    }
+    size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= hw; threads *= 2) {
+        NPC_array arr;
+        std::string label = "load/parallel/threads=" + std::to_string(threads);
+        report_throughput(label.c_str(), count,
+                          time_ms([&] { NPCFactory::load_from_file_parallel(path, arr, threads); }), bytes);
+    }
+    std::remove(path);
+}
+
+static void bench_snapshot(size_t count) {
+    const char* path = "bench_world.bin";
+    NPC_array arr;
+    make_uniform_world(arr, count, 3);
+    report("snapshot/save_binary", count, time_ms([&] { NPCFactory::save_binary(path, arr); }));
+    size_t bytes = file_size(path);
+    NPC_array loaded;
+    report_throughput("snapshot/load_binary", count,
+                      time_ms([&] { NPCFactory::load_binary(path, loaded); }), bytes);
+    std::remove(path);
+}
+
+// Forking a world for "what if" rounds: a deep copy through the NPC copy
+// constructors against copy-on-write snapshots, and restores after small
+// edits and after a full combat round.
+static void bench_fork(size_t count) {
+    NPC_array arr;
+    make_uniform_world_pooled(arr, count, 5);
+    report("fork/deep_copy", count, time_ms([&] {
+        NPC_array copy;
+        copy.reserve(count);
+        for (const auto& npc : arr.get_npcs()) {
+            switch (npc->get_kind()) {
+                case NPCKind::squirrel: copy.add_NPC(std::make_unique<squirrel>(static_cast<const squirrel&>(*npc))); break;
+                case NPCKind::werewolf: copy.add_NPC(std::make_unique<werewolf>(static_cast<const werewolf&>(*npc))); break;
+                case NPCKind::druid: copy.add_NPC(std::make_unique<druid>(static_cast<const druid&>(*npc))); break;
+                default: copy.add_NPC(std::make_unique<NPC>(*npc)); break;
+            }
+        }
+    }));
+    WorldSnapshot snap;
+    report("fork/snapshot_first", count, time_ms([&] { snap = arr.snapshot(); }));
+    report("fork/snapshot_unchanged", count, time_ms([&] { snap = arr.snapshot(); }));
+    report("fork/restore_unchanged", count, time_ms([&] { arr.restore(snap); }));
+
+    std::mt19937 gen(6);
+    size_t edits = std::min<size_t>(count, 1000);
+    for (size_t k = 0; k < edits; ++k) {
+        arr.get_npcs()[gen() % count]->set_x(1.0);
+    }
+    report("fork/restore_moved=1000", count, time_ms([&] { arr.restore(snap); }));
+    for (size_t k = 0; k < edits; ++k) {
+        arr.get_npcs()[gen() % count]->kill_npc();
+    }
+    arr.erase_dead();
+    report("fork/restore_killed=1000", count, time_ms([&] { arr.restore(snap); }));
+
+    CombatVisitor combat;
+    combat.do_combat(arr, 2.0);
+    size_t survivors = arr.get_size();
+    WorldSnapshot after;
+    report("fork/snapshot_after_round", survivors, time_ms([&] { after = arr.snapshot(); }));
+    report("fork/restore_after_round", count, time_ms([&] { arr.restore(snap); }));
+    if (arr.get_size() != count) {
+        printf("unexpected: %zu NPCs after restore\n", arr.get_size());
+    }
+}
+
+static void bench_save_text(size_t count) {
+    const char* path = "bench_save.txt";
+    NPC_array arr;
+    make_uniform_world(arr, count, 4);
+    report("save/fprintf", count, time_ms([&] {
+        FILE* file = fopen(path, "w");
+        for (auto& npc : arr.get_npcs()) {
+            std::string_view name = npc->get_name();
+            fprintf(file, "%s %.*s %lf %lf\n", npc->get_type().c_str(), static_cast<int>(name.size()),
+                    name.data(), npc->get_x_cord(), npc->get_y_cord());
+        }
+        fclose(file);
+    }));
+    report("save/text_writer", count, time_ms([&] { NPCFactory::save_to_file(path, arr); }));
+    std::remove(path);
+}
+
+static double peak_rss_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+// Each layout runs in a forked child so ru_maxrss is its own peak.
+static void bench_arena(size_t count) {
+    for (bool pooled : {false, true}) {
+        ChildMetrics m = in_child([&](ChildMetrics& out) {
+            NPC_array arr;
+            out[0] = time_ms([&] {
+                if (pooled) {
+                    make_uniform_world_pooled(arr, count, 1);
+                }
+                else {
+                    make_uniform_world(arr, count, 1);
+                }
+            });
+            CombatVisitor combat;
+            out[1] = time_ms([&] { combat.do_combat(arr, 2.0); });
+            out[2] = time_ms([&] { arr.clear(); });
+            out[3] = peak_rss_mb();
+        });
+        const char* label = pooled ? "layout/arena" : "layout/heap";
+        printf("%-28s n=%-9zu build %8.2f ms  combat %8.2f ms  clear %7.2f ms  peak RSS %7.1f MB\n",
+               label, count, m[0], m[1], m[2], m[3]);
+        record({label, {{"n", std::to_string(count)}},
+                {{"build_ms", m[0]}, {"combat_ms", m[1]}, {"clear_ms", m[2]}, {"peak_rss_mb", m[3]}}});
+    }
+}
+
+// One round over a tile-sorted file: loaded whole versus streamed through
+// a window of tile rows. The file is written and each mode run in its own
+// child, so each peak RSS is that mode's alone.
+static void bench_streaming(size_t count) {
+    const double rad = 2.0;
+    const double tile = 2.0;
+    const char* input = "bench_stream_in.txt";
+    const char* output = "bench_stream_out.txt";
+    in_child([&](ChildMetrics&) {
+        WorldSpec spec;
+        spec.count = count;
+        spec.seed = 5;
+        TextWriter out(input);
+        generate_tiled_world(spec, tile, [&](NPCKind kind, std::string_view name, double x, double y) {
+            out.append(kind_name(kind));
+            out.put(' ');
+            out.append(name);
+            out.put(' ');
+            out.append_fixed(x);
+            out.put(' ');
+            out.append_fixed(y);
+            out.put('\n');
+        });
+        out.close();
+    });
+    for (bool streamed : {false, true}) {
+        ChildMetrics m = in_child([&](ChildMetrics& out) {
+            CombatVisitor combat;
+            out[0] = time_ms([&] {
+                if (streamed) {
+                    StreamingCombat streaming(combat, tile);
+                    out[2] = streaming.run(input, output, rad).peak_resident;
+                }
+                else {
+                    NPC_array arr;
+                    NPCFactory::load_from_file_c_style(input, arr);
+                    out[2] = arr.get_size();
+                    combat.do_combat(arr, rad);
+                    NPCFactory::save_to_file(output, arr);
+                }
+            });
+            out[1] = peak_rss_mb();
+        });
+        const char* label = streamed ? "stream/tiled" : "stream/in-memory";
+        printf("%-28s n=%-9zu %10.2f ms  resident %9.0f NPCs  peak RSS %7.1f MB\n",
+               label, count, m[0], m[2], m[1]);
+        record({label, {{"n", std::to_string(count)}, {"radius", param(rad)}, {"tile", param(tile)}},
+                {{"ms", m[0]}, {"resident_npcs", m[2]}, {"peak_rss_mb", m[1]}}});
+    }
+    std::remove(input);
+    std::remove(output);
+}
+
+// Kernel alone over contiguous columns, then the full stage with its
+// gather from and scatter back to the NPCs.
+static void bench_movement(size_t count) {
+    const int steps = 10;
+    std::mt19937 gen(6);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    std::uniform_real_distribution<double> dir(-1.0, 1.0);
+    std::vector<double> x(count), y(count), vx(count), vy(count), speed(count, 1.5);
+    for (size_t i = 0; i < count; ++i) {
+        x[i] = coord(gen);
+        y[i] = coord(gen);
+        vx[i] = dir(gen);
+        vy[i] = dir(gen);
+    }
+    std::pair<const char*, MoveKernel> kernels[] = {
+        {"move/kernel/scalar", move_scalar},
+        {"move/kernel/selected", select_move_kernel()},
+    };
+    for (auto& [label, kernel] : kernels) {
+        double ms = time_ms([&] {
+            for (int s = 0; s < steps; ++s) {
+                kernel(x.data(), y.data(), vx.data(), vy.data(), speed.data(), count, WORLD_SIZE);
+            }
+        });
+        printf("%-28s n=%-9zu %10.2f ms %12.0f updates/s\n", label, count, ms / steps, count * steps / ms * 1000.0);
+        record({label, {{"n", std::to_string(count)}}, {{"ms", ms / steps}, {"updates_per_s", count * steps / ms * 1000.0}}});
+    }
+    NPC_array arr;
+    make_uniform_world_pooled(arr, count, 1);
+    MovementStage stage(1);
+    stage.step(arr);
+    double ms = time_ms([&] {
+        for (int s = 0; s < steps; ++s) {
+            stage.step(arr);
+        }
+    });
+    printf("%-28s n=%-9zu %10.2f ms %12.0f updates/s\n", "move/stage", count, ms / steps, count * steps / ms * 1000.0);
+    record({"move/stage", {{"n", std::to_string(count)}}, {{"ms", ms / steps}, {"updates_per_s", count * steps / ms * 1000.0}}});
+}
+
+// Despawns up to 100k named NPCs and as many positions one call at a time.
+// Linear removals walk the whole array, so the baseline does only 1000.
+static void bench_index(size_t count) {
+    std::mt19937 gen(9);
+    std::vector<size_t> victims(count);
+    for (size_t i = 0; i < count; ++i) {
+        victims[i] = i;
+    }
+    std::shuffle(victims.begin(), victims.end(), gen);
+    for (bool indexed : {false, true}) {
+        size_t removals = std::min<size_t>(count / 2, indexed ? 100000 : 1000);
+        NPC_array arr;
+        make_uniform_world_pooled(arr, count, 1);
+        arr.set_indexed(indexed);
+        std::vector<std::string> names;
+        std::vector<std::pair<double, double>> coords;
+        for (size_t k = 0; k < removals; ++k) {
+            names.emplace_back(arr.get_npcs()[victims[k]]->get_name());
+            const NPC& npc = *arr.get_npcs()[victims[removals + k]];
+            coords.emplace_back(npc.get_x_cord(), npc.get_y_cord());
+        }
+        std::string suffix = "/world=" + std::to_string(count);
+        std::string label = (indexed ? "index/remove_npc" : "linear/remove_npc") + suffix;
+        report(label.c_str(), removals, time_ms([&] {
+            for (auto& name : names) {
+                arr.remove_npc(name);
+            }
+        }));
+        label = (indexed ? "index/remove_at" : "linear/remove_at") + suffix;
+        report(label.c_str(), removals, time_ms([&] {
+            for (auto [x, y] : coords) {
+                arr.remove_at(x, y);
+            }
+        }));
+        if (arr.get_size() != count - 2 * removals) {
+            printf("unexpected: %zu NPCs left\n", arr.get_size());
+        }
+    }
+}
+
+// Worlds that reuse a few names against one name per NPC, each in a
+// forked child.
+static void bench_names(size_t count) {
+    for (size_t distinct : {size_t(16), count}) {
+        ChildMetrics m = in_child([&](ChildMetrics& out) {
+            std::vector<std::string> pool;
+            for (size_t i = 0; i < distinct; ++i) {
+                pool.push_back("npc" + std::to_string(i));
+            }
+            std::mt19937 gen(1);
+            std::uniform_real_distribution<double> coord(0.0, 500.0);
+            const NPCKind kinds[] = {NPCKind::squirrel, NPCKind::werewolf, NPCKind::druid};
+            NPC_array arr;
+            arr.reserve(count);
+            size_t before = allocations.load();
+            out[0] = time_ms([&] {
+                for (size_t i = 0; i < count; ++i) {
+                    double x = coord(gen);
+                    arr.emplace_npc(kinds[gen() % 3], pool[i % distinct], x, coord(gen));
+                }
+            });
+            out[1] = double(allocations.load() - before);
+            out[2] = time_ms([&] {
+                for (size_t i = 0; i < 1000; ++i) {
+                    arr.remove_npc(pool[(i * 7919) % distinct] + "?");
+                }
+            });
+            out[3] = peak_rss_mb();
+        });
+        std::string label = distinct < count ? "names/distinct=16" : "names/unique";
+        printf("%-28s n=%-9zu build %8.2f ms %9.0f allocs  1000 misses %6.2f ms  peak RSS %7.1f MB\n",
+               label.c_str(), count, m[0], m[1], m[2], m[3]);
+        record({label, {{"n", std::to_string(count)}},
+                {{"build_ms", m[0]}, {"allocs", m[1]}, {"miss_ms", m[2]}, {"peak_rss_mb", m[3]}}});
+    }
+}
+
+// Counts events the way a logger would see them, formatting each one.
+class FormattingObserver : public Observer {
+    public:
+        void update(const std::string& event) override { bytes += event.size(); }
+        void update(const CombatEvent& event) override {
+            line.clear();
+            append_event(line, event);
+            bytes += line.size();
+            ++events;
+        }
+        size_t events = 0;
+        size_t bytes = 0;
+    private:
+        std::string line;
+};
+
+struct CaseOptions {
+    std::vector<size_t> counts;
+    std::vector<double> radii = {2.0, 10.0};
+    std::vector<std::string> mixes = {"1:1:1", "4:1:1", "1:1:4"};
+    std::vector<std::string> dists = {"uniform", "clustered"};
+    std::vector<std::string> observers = {"off", "on"};
+};
+
+// One full combat round for every combination of the options.
+static void bench_cases(const CaseOptions& options) {
+    for (size_t count : options.counts) {
+        for (const auto& dist : options.dists) {
+            if (dist != "uniform" && dist != "clustered") {
+                throw std::invalid_argument("bad distribution: " + dist);
+            }
+            for (const auto& mix : options.mixes) {
+                WorldSpec spec;
+                spec.count = count;
+                spec.clustered = dist == "clustered";
+                parse_mix(mix, spec.mix);
+                for (double rad : options.radii) {
+                    for (const auto& obs : options.observers) {
+                        if (obs != "on" && obs != "off") {
+                            throw std::invalid_argument("bad observers: " + obs);
+                        }
+                        NPC_array arr;
+                        arr.reserve(count);
+                        generate_world(spec, [&](NPCKind kind, std::string_view name, double x, double y) {
+                            arr.emplace_npc(kind, name, x, y);
+                        });
+                        CombatVisitor combat;
+                        auto observer = std::make_unique<FormattingObserver>();
+                        FormattingObserver* seen = observer.get();
+                        if (obs == "on") {
+                            combat.add_observer(std::move(observer));
+                        }
+                        double ms = time_ms([&] { combat.do_combat(arr, rad); });
+                        double kills = double(count - arr.get_size());
+                        printf("%-28s n=%-9zu rad=%-5.1f mix=%-6s %-9s obs=%-3s %10.2f ms %9.0f kills\n", "combat/case",
+                               count, rad, mix.c_str(), dist.c_str(), obs.c_str(), ms, kills);
+                        record({"combat/case",
+                                {{"n", std::to_string(count)}, {"radius", param(rad)}, {"mix", mix},
+                                 {"dist", dist}, {"observers", obs}},
+                                {{"ms", ms}, {"kills", kills}, {"events", double(obs == "on" ? seen->events : 0)}}});
+                    }
+                }
+            }
+        }
+    }
+}
+
+static std::vector<std::string> split(const std::string& text) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+        size_t comma = text.find(',', start);
+        parts.push_back(text.substr(start, comma - start));
+        if (comma == std::string::npos) {
+            return parts;
+        }
+        start = comma + 1;
+    }
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: bench [max_count] [group] [--json FILE]\n"
+            "             [--count N,...] [--radius R,...] [--mix S:W:D,...]\n"
+            "             [--dist uniform,clustered] [--observers off,on]\n");
+}
+
+int main(int argc, char** argv) {
+    stats_allocation_counter = [] { return uint64_t(allocations.load(std::memory_order_relaxed)); };
+    size_t max_count = 1000000;
+    std::string filter;
+    std::string json;
+    CaseOptions cases;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (i + 1 == argc) {
+            usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--json") {
+            json = value;
+        }
+        else if (arg == "--count") {
+            cases.counts.clear();
+            for (auto& v : split(value)) {
+                cases.counts.push_back(std::strtoull(v.c_str(), nullptr, 10));
+            }
+        }
+        else if (arg == "--radius") {
+            cases.radii.clear();
+            for (auto& v : split(value)) {
+                cases.radii.push_back(std::strtod(v.c_str(), nullptr));
+            }
+        }
+        else if (arg == "--mix") {
+            cases.mixes = split(value);
+        }
+        else if (arg == "--dist") {
+            cases.dists = split(value);
+        }
+        else if (arg == "--observers") {
+            cases.observers = split(value);
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (positional.size() > 0) {
+        max_count = std::strtoull(positional[0].c_str(), nullptr, 10);
+    }
+    if (positional.size() > 1) {
+        filter = positional[1];
+    }
+    if (cases.counts.empty()) {
+        cases.counts.push_back(std::min<size_t>(max_count, 100000));
+    }
+    auto wants = [&](const char* group) { return filter.empty() || filter == group; };
+    if (wants("combat")) {
+        bench_combat_scaling(max_count);
+        bench_combat_threads(max_count);
+        bench_combat_ticks(max_count);
+        bench_combat_allocations(std::min<size_t>(max_count, 100000));
+    }
+    if (wants("stats")) {
+        bench_stats(max_count);
+    }
+    if (wants("bus")) {
+        bench_event_bus(std::min<size_t>(max_count, 100000));
+    }
+    if (wants("rules")) {
+        bench_rules(max_count);
+    }
+    if (wants("kdtree")) {
+        bench_kdtree(max_count);
+    }
+    if (wants("dispatch")) {
+        bench_dispatch(max_count);
+    }
+    if (wants("kernel")) {
+        bench_range_kernels();
+    }
+    if (wants("cleanup")) {
+        bench_cleanup(max_count);
+    }
+    if (wants("logger")) {
+        bench_loggers(std::min<size_t>(max_count, 200000));
+    }
+    if (wants("load")) {
+        bench_loaders(max_count);
+    }
+    if (wants("arena")) {
+        bench_arena(max_count);
+    }
+    if (wants("move")) {
+        bench_movement(max_count);
+    }
+    if (wants("index")) {
+        bench_index(max_count);
+    }
+    if (wants("names")) {
+        bench_names(max_count);
+    }
+    if (wants("save")) {
+        bench_save_text(max_count);
+    }
+    if (wants("stream")) {
+        bench_streaming(max_count);
+    }
+    if (wants("snapshot")) {
+        bench_snapshot(max_count);
+    }
+    if (wants("fork")) {
+        bench_fork(max_count);
+    }
+    if (wants("cases")) {
+        bench_cases(cases);
+    }
+    if (!json.empty()) {
+        write_json(json.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,263 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "NPC.h"
+#include "Streaming.h"
+#include "TextWriter.h"
+
+// One measured case, kept for the JSON report next to the printed line.
+struct BenchResult {
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> params;
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+inline std::vector<BenchResult>& bench_results() {
+    static std::vector<BenchResult> results;
+    return results;
+}
+
+inline std::string param(double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%g", value);
+    return buf;
+}
+
+inline void record(BenchResult result) {
+    bench_results().push_back(std::move(result));
+}
+
+inline void write_json_string(FILE* file, const std::string& text) {
+    fputc('"', file);
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            fprintf(file, "\\u%04x", static_cast<unsigned>(c));
+            continue;
+        }
+        fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+// {"results": [{"name": ..., "params": {...}, "metrics": {...}}, ...]}
+inline void write_json(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        throw std::runtime_error("can't open file");
+    }
+    fprintf(file, "{\n  \"results\": [");
+    const char* sep = "\n";
+    for (const auto& result : bench_results()) {
+        fprintf(file, "%s    {\"name\": ", sep);
+        write_json_string(file, result.name);
+        fprintf(file, ", \"params\": {");
+        for (size_t k = 0; k < result.params.size(); ++k) {
+            fprintf(file, k ? ", " : "");
+            write_json_string(file, result.params[k].first);
+            fprintf(file, ": ");
+            write_json_string(file, result.params[k].second);
+        }
+        fprintf(file, "}, \"metrics\": {");
+        for (size_t k = 0; k < result.metrics.size(); ++k) {
+            fprintf(file, k ? ", " : "");
+            write_json_string(file, result.metrics[k].first);
+            double value = result.metrics[k].second;
+            if (std::isfinite(value)) {
+                fprintf(file, ": %.10g", value);
+            }
+            else {
+                fprintf(file, ": null");
+            }
+        }
+        fprintf(file, "}}");
+        sep = ",\n";
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+}
+
+// Runs f in a forked child so that ru_maxrss is its own peak. f fills up
+// to eight metrics, which come back through a shared mapping.
+using ChildMetrics = std::array<double, 8>;
+
+template <typename F>
+ChildMetrics in_child(F&& f) {
+    void* shared = mmap(nullptr, sizeof(ChildMetrics), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        throw std::runtime_error("can't map shared memory");
+    }
+    ChildMetrics* out = new (shared) ChildMetrics{};
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        f(*out);
+        fflush(stdout);
+        _exit(0);
+    }
+    waitpid(pid, nullptr, 0);
+    ChildMetrics result = *out;
+    munmap(shared, sizeof(ChildMetrics));
+    return result;
+}
+
+// Synthetic world: kinds drawn with the weights in mix, positions either
+// uniform over the map or normal around a few random cluster centres.
+struct WorldSpec {
+    size_t count = 1000;
+    double mix[3] = {1, 1, 1};  // squirrel : werewolf : druid
+    bool clustered = false;
+    size_t clusters = 16;
+    double spread = 25.0;
+    unsigned seed = 1;
+};
+
+// "a:b:c" weights of squirrels, werewolves and druids.
+inline void parse_mix(const std::string& text, double mix[3]) {
+    if (sscanf(text.c_str(), "%lf:%lf:%lf", &mix[0], &mix[1], &mix[2]) != 3 ||
+        mix[0] < 0 || mix[1] < 0 || mix[2] < 0 || mix[0] + mix[1] + mix[2] <= 0) {
+        throw std::invalid_argument("bad mix: " + text);
+    }
+}
+
+// Calls emit(kind, name, x, y) for every NPC of the world.
+template <typename F>
+void generate_world(const WorldSpec& spec, F&& emit) {
+    std::mt19937_64 gen(spec.seed);
+    std::uniform_real_distribution<double> coord(0.0, WORLD_SIZE);
+    std::discrete_distribution<int> kind(spec.mix, spec.mix + 3);
+    std::normal_distribution<double> offset(0.0, spec.spread);
+    std::vector<std::pair<double, double>> centres;
+    for (size_t c = 0; spec.clustered && c < spec.clusters; ++c) {
+        double x = coord(gen);
+        centres.emplace_back(x, coord(gen));
+    }
+    const NPCKind kinds[] = {NPCKind::squirrel, NPCKind::werewolf, NPCKind::druid};
+    char name[32] = "npc";
+    for (size_t i = 0; i < spec.count; ++i) {
+        NPCKind k = kinds[kind(gen)];
+        double x, y;
+        if (spec.clustered) {
+            auto [cx, cy] = centres[gen() % centres.size()];
+            x = std::clamp(cx + offset(gen), 0.0, WORLD_SIZE);
+            y = std::clamp(cy + offset(gen), 0.0, WORLD_SIZE);
+        }
+        else {
+            x = coord(gen);
+            y = coord(gen);
+        }
+        auto end = std::to_chars(name + 3, name + sizeof(name), i).ptr;
+        emit(k, std::string_view(name, end - name), x, y);
+    }
+}
+
+// generate_world sorted into tiles for StreamingCombat; holds the whole
+// world. Tiles come from the coordinates as they will be read back, so
+// rounding to six decimals cannot move a record into another tile.
+template <typename F>
+void generate_tiled_world(const WorldSpec& spec, double tile, F&& emit) {
+    struct Record {
+        int64_t row, col;
+        NPCKind kind;
+        std::string name;
+        double x, y;
+    };
+    std::vector<Record> records;
+    records.reserve(spec.count);
+    char text[TextWriter::MAX_FIXED];
+    auto as_read = [&](double v) {
+        snprintf(text, sizeof(text), "%f", v);
+        return std::strtod(text, nullptr);
+    };
+    generate_world(spec, [&](NPCKind kind, std::string_view name, double x, double y) {
+        x = as_read(x);
+        y = as_read(y);
+        records.push_back({tile_row(y, tile), tile_col(x, tile), kind, std::string(name), x, y});
+    });
+    std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+    for (const Record& r : records) {
+        emit(r.kind, r.name, r.x, r.y);
+    }
+}
+
+template <typename F>
+double time_ms(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+inline void make_uniform_world(NPC_array& arr, size_t count, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    const char* types[] = {"squirrel", "werewolf", "druid"};
+    for (size_t i = 0; i < count; ++i) {
+        arr.add_NPC(NPCFactory::create_npc(types[gen() % 3], "npc" + std::to_string(i),
+                                           coord(gen), coord(gen)));
+    }
+}
+
+// Same world as make_uniform_world, built in the array's slot pools.
+inline void make_uniform_world_pooled(NPC_array& arr, size_t count, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    const NPCKind kinds[] = {NPCKind::squirrel, NPCKind::werewolf, NPCKind::druid};
+    arr.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        NPCKind kind = kinds[gen() % 3];
+        double x = coord(gen);
+        arr.emplace_npc(kind, "npc" + std::to_string(i), x, coord(gen));
+    }
+}
+
+inline void report(const char* bench, size_t count, double ms) {
+    printf("%-28s n=%-9zu %10.2f ms\n", bench, count, ms);
+    record({bench, {{"n", std::to_string(count)}}, {{"ms", ms}}});
+}
+
+// Writes count random records in the npc.txt format.
+inline void write_world_file(const char* path, size_t count, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    const char* types[] = {"squirrel", "werewolf", "druid"};
+    FILE* file = fopen(path, "w");
+    for (size_t i = 0; i < count; ++i) {
+        double x = coord(gen);
+        double y = coord(gen);
+        fprintf(file, "%s npc%zu %.3f %.3f\n", types[gen() % 3], i, x, y);
+    }
+    fclose(file);
+}
+
+inline size_t file_size(const char* path) {
+    FILE* file = fopen(path, "rb");
+    fseek(file, 0, SEEK_END);
+    size_t size = static_cast<size_t>(ftell(file));
+    fclose(file);
+    return size;
+}
+
+inline void report_throughput(const char* bench, size_t count, double ms, size_t bytes) {
+    printf("%-28s n=%-9zu %10.2f ms %10.1f MB/s\n", bench, count, ms, bytes / 1e6 / (ms / 1000.0));
+    record({bench, {{"n", std::to_string(count)}}, {{"ms", ms}, {"mb_per_s", bytes / 1e6 / (ms / 1000.0)}}});
+}
@@ -0,0 +1,84 @@
+#include "bench.h"
+#include "TextWriter.h"
+
+#include <cstdlib>
+#include <string>
+
+static int usage() {
+    fprintf(stderr,
+            "usage: npcgen <file> <count> [--seed N] [--mix S:W:D] [--dist uniform|clustered]\n"
+            "              [--clusters N] [--spread R] [--tile T]\n");
+    return 1;
+}
+
+// Writes a synthetic world in the npc.txt format, streaming, so the file
+// can be far larger than memory. With --tile the records are sorted into
+// tiles for StreamingCombat, which holds the whole world while sorting.
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        return usage();
+    }
+    WorldSpec spec;
+    double tile = 0;
+    spec.count = std::strtoull(argv[2], nullptr, 10);
+    try {
+        for (int i = 3; i < argc; i += 2) {
+            std::string arg = argv[i];
+            if (i + 1 == argc) {
+                // a dropped --tile would silently write an unsorted world
+                fprintf(stderr, "missing value for %s\n", arg.c_str());
+                return usage();
+            }
+            std::string value = argv[i + 1];
+            if (arg == "--seed") {
+                spec.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+            }
+            else if (arg == "--mix") {
+                parse_mix(value, spec.mix);
+            }
+            else if (arg == "--dist") {
+                if (value != "uniform" && value != "clustered") {
+                    throw std::invalid_argument("bad distribution: " + value);
+                }
+                spec.clustered = value == "clustered";
+            }
+            else if (arg == "--clusters") {
+                spec.clusters = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10));
+            }
+            else if (arg == "--spread") {
+                spec.spread = std::strtod(value.c_str(), nullptr);
+            }
+            else if (arg == "--tile") {
+                tile = std::strtod(value.c_str(), nullptr);
+                if (!(tile > 0)) {
+                    throw std::invalid_argument("bad tile size: " + value);
+                }
+            }
+            else {
+                throw std::invalid_argument("unknown option: " + arg);
+            }
+        }
+        TextWriter out(argv[1]);
+        auto write = [&](NPCKind kind, std::string_view name, double x, double y) {
+            out.append(kind_name(kind));
+            out.put(' ');
+            out.append(name);
+            out.put(' ');
+            out.append_fixed(x);
+            out.put(' ');
+            out.append_fixed(y);
+            out.put('\n');
+        };
+        if (tile > 0) {
+            generate_tiled_world(spec, tile, write);
+        }
+        else {
+            generate_world(spec, write);
+        }
+        out.close();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
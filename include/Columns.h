@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "NPC.h"
+
+// Column-oriented copy of an NPC_array: slot i of every column describes
+// the i-th NPC of the array. Buffers keep their capacity between assign()
+// calls, so refreshing the columns every round does not allocate.
+class NPC_columns {
+    public:
+        void assign(const NPC_array& arr) {
+            size_t n = arr.get_size();
+            x.resize(n);
+            y.resize(n);
+            kind.resize(n);
+            name_id.resize(n);
+            alive.assign((n + 63) / 64, 0);
+            dirty.clear();
+            size_t i = 0;
+            for (const auto& npc : arr.get_npcs()) {
+                x[i] = npc->get_x_cord();
+                y[i] = npc->get_y_cord();
+                kind[i] = npc->get_kind();
+                name_id[i] = npc->get_name_id();
+                if (npc->is_alive_NPC()) {
+                    alive[i / 64] |= uint64_t(1) << (i % 64);
+                }
+                if (npc->is_dirty()) {
+                    dirty.push_back(static_cast<uint32_t>(i));
+                }
+                ++i;
+            }
+        }
+        size_t size() const { return x.size(); }
+        bool is_alive(size_t i) const { return (alive[i / 64] >> (i % 64)) & 1; }
+        void kill(size_t i) { alive[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<NPCKind> kind;
+        std::vector<uint32_t> name_id;
+        std::vector<uint64_t> alive;
+        std::vector<uint32_t> dirty;  // indices of dirty NPCs, ascending
+};
@@ -0,0 +1,129 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Observer.h"
+
+// An observer and the thread that feeds it batches in publish order. A
+// slow observer only falls behind on its own queue.
+class ObserverThread {
+    public:
+        explicit ObserverThread(std::unique_ptr<Observer>&& obs)
+            : observer(std::move(obs)), worker([this] { run(); }) {}
+        ObserverThread(const ObserverThread&) = delete;
+        ObserverThread& operator=(const ObserverThread&) = delete;
+        ~ObserverThread() { stop(); }
+
+        void push(std::shared_ptr<const EventBatch> batch) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(std::move(batch));
+            }
+            wake.notify_one();
+        }
+        // Blocks until every batch pushed so far has been handled.
+        void wait_idle() {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this] { return queue.empty() && !busy; });
+        }
+        // Drains the queue, joins the thread and hands the observer back.
+        std::unique_ptr<Observer> release() {
+            stop();
+            return std::move(observer);
+        }
+        size_t get_pending() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return queue.size();
+        }
+
+    private:
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                std::shared_ptr<const EventBatch> batch = std::move(queue.front());
+                queue.pop_front();
+                busy = true;
+                lock.unlock();
+                try {
+                    observer->update_batch(*batch);
+                    if (batch->has_stats) {
+                        observer->round_done(batch->stats);
+                    }
+                } catch (const std::exception& e) {
+                    fprintf(stderr, "observer failed: %s\n", e.what());
+                }
+                batch.reset();
+                lock.lock();
+                busy = false;
+                if (queue.empty()) {
+                    idle.notify_all();
+                }
+            }
+        }
+
+        std::unique_ptr<Observer> observer;
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        std::deque<std::shared_ptr<const EventBatch>> queue;
+        bool busy = false;
+        bool stopping = false;
+        std::thread worker;  // last: starts once the rest is constructed
+};
+
+// Fans every published batch out to all subscribers; each one handles
+// its batches on its own thread, in publish order. Queues are unbounded,
+// so publishing never waits for an observer.
+class EventBus {
+    public:
+        void subscribe(std::unique_ptr<Observer>&& obs) {
+            threads.push_back(std::make_unique<ObserverThread>(std::move(obs)));
+        }
+        void publish(EventBatch&& batch) {
+            // sealed in place: moving the batch may move short names
+            auto sealed = std::make_shared<EventBatch>(std::move(batch));
+            sealed->seal();
+            std::shared_ptr<const EventBatch> shared = std::move(sealed);
+            for (auto& thread : threads) {
+                thread->push(shared);
+            }
+        }
+        void flush() {
+            for (auto& thread : threads) {
+                thread->wait_idle();
+            }
+        }
+        // Delivers what is queued, then returns the observers.
+        std::vector<std::unique_ptr<Observer>> close() {
+            std::vector<std::unique_ptr<Observer>> observers;
+            for (auto& thread : threads) {
+                observers.push_back(thread->release());
+            }
+            threads.clear();
+            return observers;
+        }
+        size_t size() const { return threads.size(); }
+
+    private:
+        std::vector<std::unique_ptr<ObserverThread>> threads;
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Uniform grid over NPC positions. The cell side is never smaller than the
+// combat radius, so every pair in range sits in the same or in adjacent cells.
+class UniformGrid {
+    public:
+        static constexpr size_t MAX_CELLS_PER_AXIS = 1024;
+
+        // Returns false when a grid would not help (non-finite input or
+        // everything fits into a 3x3 block) and the caller should brute force.
+        bool build(const double* xs, const double* ys, size_t n, double rad) {
+            count = n;
+            if (n == 0 || !std::isfinite(rad)) {
+                return false;
+            }
+            min_x = max_x = xs[0];
+            min_y = max_y = ys[0];
+            for (size_t i = 0; i < n; ++i) {
+                if (!std::isfinite(xs[i]) || !std::isfinite(ys[i])) {
+                    return false;
+                }
+                min_x = std::min(min_x, xs[i]);
+                max_x = std::max(max_x, xs[i]);
+                min_y = std::min(min_y, ys[i]);
+                max_y = std::max(max_y, ys[i]);
+            }
+            double extent = std::max(max_x - min_x, max_y - min_y);
+            // small margin keeps floor() rounding from pushing an in-range pair two cells apart
+            cell = std::max(std::fabs(rad) * (1.0 + 1e-7), extent / MAX_CELLS_PER_AXIS);
+            if (!(cell > 0)) {
+                return false;
+            }
+            nx = static_cast<size_t>((max_x - min_x) / cell) + 1;
+            ny = static_cast<size_t>((max_y - min_y) / cell) + 1;
+            if (nx <= 3 && ny <= 3) {
+                return false;
+            }
+            cell_start.assign(nx * ny + 1, 0);
+            cell_of.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                cell_of[i] = static_cast<uint32_t>(cell_y(ys[i]) * nx + cell_x(xs[i]));
+                cell_start[cell_of[i] + 1]++;
+            }
+            for (size_t c = 0; c < nx * ny; ++c) {
+                cell_start[c + 1] += cell_start[c];
+            }
+            // counting sort is stable: indices inside a cell stay ascending;
+            // coordinates are copied in cell order so runs scan contiguously
+            order.resize(n);
+            px.resize(n);
+            py.resize(n);
+            std::vector<uint32_t> fill(cell_start.begin(), cell_start.end() - 1);
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t pos = fill[cell_of[i]]++;
+                order[pos] = static_cast<uint32_t>(i);
+                px[pos] = xs[i];
+                py[pos] = ys[i];
+            }
+            return true;
+        }
+
+        // Calls f(first, last) with half-open runs of grid positions covering
+        // the 3x3 block of cells around (x, y). Position p holds the NPC with
+        // build index get_order()[p] at (get_x()[p], get_y()[p]).
+        template <typename F>
+        void for_each_neighbor_run(double x, double y, F&& f) const {
+            size_t cx = cell_x(x);
+            size_t cy = cell_y(y);
+            size_t x0 = cx > 0 ? cx - 1 : 0;
+            size_t x1 = std::min(cx + 1, nx - 1);
+            size_t y0 = cy > 0 ? cy - 1 : 0;
+            size_t y1 = std::min(cy + 1, ny - 1);
+            for (size_t gy = y0; gy <= y1; ++gy) {
+                // cells of a row are adjacent in the CSR layout, so one run per row
+                size_t first = gy * nx + x0;
+                size_t last = gy * nx + x1;
+                size_t b = cell_start[first];
+                size_t e = cell_start[last + 1];
+                if (b != e) {
+                    f(b, e);
+                }
+            }
+        }
+
+        const uint32_t* get_order() const { return order.data(); }
+        const double* get_x() const { return px.data(); }
+        const double* get_y() const { return py.data(); }
+        size_t get_cells_x() const { return nx; }
+        size_t get_cells_y() const { return ny; }
+        double get_cell_size() const { return cell; }
+
+    private:
+        size_t cell_x(double x) const {
+            return std::min(static_cast<size_t>((x - min_x) / cell), nx - 1);
+        }
+        size_t cell_y(double y) const {
+            return std::min(static_cast<size_t>((y - min_y) / cell), ny - 1);
+        }
+
+        size_t count = 0;
+        size_t nx = 0;
+        size_t ny = 0;
+        double cell = 0;
+        double min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+        std::vector<uint32_t> cell_start;
+        std::vector<uint32_t> cell_of;
+        std::vector<uint32_t> order;
+        std::vector<double> px;
+        std::vector<double> py;
+};
@@ -0,0 +1,157 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Open-addressing multimap from a key to array slots. All slots holding
+// the same key are chained through next[], so the table has one entry per
+// distinct key; removal uses backward shifting and leaves no tombstones.
+template <typename Key, typename Hash>
+class SlotIndex {
+    public:
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        void clear() {
+            entries.clear();
+            next.clear();
+            used = 0;
+        }
+        void reserve(size_t slots) {
+            next.reserve(slots);
+            size_t capacity = 64;
+            while (capacity < slots * 2) {
+                capacity *= 2;
+            }
+            if (capacity > entries.size()) {
+                rehash(capacity);
+            }
+        }
+        // Slots must be inserted in increasing order.
+        void insert(const Key& key, uint32_t slot) {
+            if ((used + 1) * 2 > entries.size()) {
+                rehash(entries.empty() ? 64 : entries.size() * 2);
+            }
+            next.resize(slot + 1, NONE);
+            size_t i = probe(key);
+            if (entries[i].head == NONE) {
+                entries[i].key = key;
+                ++used;
+            }
+            next[slot] = entries[i].head;
+            entries[i].head = slot;
+        }
+        // First slot of the chain of key, NONE when there is none.
+        uint32_t find(const Key& key) const {
+            if (entries.empty()) {
+                return NONE;
+            }
+            return entries[probe(key)].head;
+        }
+        uint32_t next_of(uint32_t slot) const { return next[slot]; }
+        // Unlinks the whole chain of key and returns its first slot.
+        uint32_t take(const Key& key) {
+            if (entries.empty()) {
+                return NONE;
+            }
+            size_t mask = entries.size() - 1;
+            size_t i = probe(key);
+            uint32_t head = entries[i].head;
+            if (head == NONE) {
+                return NONE;
+            }
+            entries[i].head = NONE;
+            --used;
+            for (size_t j = (i + 1) & mask; entries[j].head != NONE; j = (j + 1) & mask) {
+                size_t home = Hash{}(entries[j].key) & mask;
+                // entry j may move into the hole at i unless its home lies
+                // cyclically in (i, j]
+                if (((j - home) & mask) >= ((j - i) & mask)) {
+                    entries[i] = entries[j];
+                    entries[j].head = NONE;
+                    i = j;
+                }
+            }
+            return head;
+        }
+
+    private:
+        struct Entry {
+            Key key{};
+            uint32_t head = NONE;
+        };
+
+        size_t probe(const Key& key) const {
+            size_t mask = entries.size() - 1;
+            size_t i = Hash{}(key) & mask;
+            while (entries[i].head != NONE && !(entries[i].key == key)) {
+                i = (i + 1) & mask;
+            }
+            return i;
+        }
+        void rehash(size_t capacity) {
+            std::vector<Entry> old(capacity);
+            old.swap(entries);
+            size_t mask = capacity - 1;
+            for (const Entry& e : old) {
+                if (e.head != NONE) {
+                    size_t i = Hash{}(e.key) & mask;
+                    while (entries[i].head != NONE) {
+                        i = (i + 1) & mask;
+                    }
+                    entries[i] = e;
+                }
+            }
+        }
+
+        std::vector<Entry> entries;
+        std::vector<uint32_t> next;
+        size_t used = 0;
+};
+
+inline uint64_t mix_bits(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+struct NameIdHash {
+    size_t operator()(uint32_t id) const { return mix_bits(id); }
+};
+
+// Exact position; the bits of -0.0 are folded into 0.0 so that the key
+// matches the way remove_at compares coordinates.
+struct CoordKey {
+    uint64_t x = 0;
+    uint64_t y = 0;
+
+    static CoordKey of(double x, double y) {
+        CoordKey key;
+        x += 0.0;
+        y += 0.0;
+        std::memcpy(&key.x, &x, sizeof(x));
+        std::memcpy(&key.y, &y, sizeof(y));
+        return key;
+    }
+    bool operator==(const CoordKey& other) const { return x == other.x && y == other.y; }
+};
+
+struct CoordKeyHash {
+    size_t operator()(const CoordKey& key) const { return mix_bits(key.x ^ mix_bits(key.y)); }
+};
+
+// Secondary indexes of an NPC_array. NPCs of an indexed array point here
+// and call invalidate() when their name or position changes; the array
+// then rebuilds both maps before the next lookup.
+struct NPCIndex {
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    SlotIndex<uint32_t, NameIdHash> by_name;
+    SlotIndex<CoordKey, CoordKeyHash> by_coords;
+    bool stale = true;
+
+    void invalidate() { stale = true; }
+};
@@ -0,0 +1,201 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "NPC.h"
+
+// Bucket k-d tree over NPC positions, rebuilt from scratch in O(n log n).
+// Every node splits its points at the median of the axis with the wider
+// spread, so clusters get as many levels as they need; leaves hold up to
+// LEAF_SIZE points, stored contiguously like the grid's cells. Unlike the
+// grid, nothing is tuned to one radius, so a tree serves any mix of radii.
+class KdTree {
+    public:
+        static constexpr size_t LEAF_SIZE = 16;
+
+        // Returns false for an empty or non-finite input; then the caller
+        // should brute force.
+        bool build(const double* xs, const double* ys, size_t n) {
+            count = n;
+            order.clear();
+            px.clear();
+            py.clear();
+            if (n == 0) {
+                return false;
+            }
+            std::vector<Point> pts(n);
+            for (size_t i = 0; i < n; ++i) {
+                if (!std::isfinite(xs[i]) || !std::isfinite(ys[i])) {
+                    return false;
+                }
+                pts[i] = {xs[i], ys[i], static_cast<uint32_t>(i)};
+            }
+            size_t nodes = 1;
+            while (nodes * LEAF_SIZE < n) {
+                nodes *= 2;
+            }
+            split.assign(2 * nodes, 0.0);
+            axis.assign(2 * nodes, 0);
+            split_node(pts, 1, 0, n);
+            order.resize(n);
+            px.resize(n);
+            py.resize(n);
+            for (size_t p = 0; p < n; ++p) {
+                order[p] = pts[p].index;
+                px[p] = pts[p].x;
+                py[p] = pts[p].y;
+            }
+            return true;
+        }
+        // Indices refer to arr.get_npcs().
+        bool build(const NPC_array& arr) {
+            const auto& npcs = arr.get_npcs();
+            std::vector<double> xs(npcs.size());
+            std::vector<double> ys(npcs.size());
+            for (size_t i = 0; i < npcs.size(); ++i) {
+                xs[i] = npcs[i]->get_x_cord();
+                ys[i] = npcs[i]->get_y_cord();
+            }
+            return build(xs.data(), ys.data(), npcs.size());
+        }
+
+        // Calls f(first, last) with half-open runs of tree positions that
+        // cover every point within sqrt(rad2) of (x, y); position p holds
+        // the point with build index get_order()[p]. Pruning compares
+        // squared axis distances, rounded the same way as dx*dx + dy*dy,
+        // so no point the range kernels accept is ever skipped.
+        template <typename F>
+        void for_each_leaf_run(double x, double y, double rad2, F&& f) const {
+            if (count) {
+                visit(1, 0, count, x, y, rad2, f);
+            }
+        }
+        // Calls f(index) for every point with dx*dx + dy*dy <= rad * rad.
+        template <typename F>
+        void for_each_in_radius(double x, double y, double rad, F&& f) const {
+            double rad2 = rad * rad;
+            for_each_leaf_run(x, y, rad2, [&](size_t first, size_t last) {
+                for (size_t p = first; p < last; ++p) {
+                    double dx = x - px[p];
+                    double dy = y - py[p];
+                    if (dx * dx + dy * dy <= rad2) {
+                        f(order[p]);
+                    }
+                }
+            });
+        }
+        // The k points closest to (x, y), nearest first; equal distances
+        // go by build index.
+        void nearest(double x, double y, size_t k, std::vector<uint32_t>& out) const {
+            out.clear();
+            heap.clear();
+            if (count == 0 || k == 0) {
+                return;
+            }
+            nearest_in(1, 0, count, x, y, k);
+            std::sort_heap(heap.begin(), heap.end());
+            for (auto [d2, index] : heap) {
+                out.push_back(index);
+            }
+        }
+
+        size_t size() const { return count; }
+        const uint32_t* get_order() const { return order.data(); }
+        const double* get_x() const { return px.data(); }
+        const double* get_y() const { return py.data(); }
+
+    private:
+        struct Point {
+            double x, y;
+            uint32_t index;
+        };
+
+        // Node i covers positions [lo, hi); its children are 2i and 2i + 1
+        // and split at mid = (lo + hi) / 2, so queries recompute the ranges.
+        void split_node(std::vector<Point>& pts, size_t node, size_t lo, size_t hi) {
+            if (hi - lo <= LEAF_SIZE) {
+                return;
+            }
+            double min_x = pts[lo].x, max_x = pts[lo].x;
+            double min_y = pts[lo].y, max_y = pts[lo].y;
+            for (size_t p = lo; p < hi; ++p) {
+                min_x = std::min(min_x, pts[p].x);
+                max_x = std::max(max_x, pts[p].x);
+                min_y = std::min(min_y, pts[p].y);
+                max_y = std::max(max_y, pts[p].y);
+            }
+            bool by_y = max_y - min_y > max_x - min_x;
+            size_t mid = (lo + hi) / 2;
+            std::nth_element(pts.begin() + lo, pts.begin() + mid, pts.begin() + hi,
+                             [by_y](const Point& a, const Point& b) { return by_y ? a.y < b.y : a.x < b.x; });
+            axis[node] = by_y;
+            split[node] = by_y ? pts[mid].y : pts[mid].x;
+            split_node(pts, 2 * node, lo, mid);
+            split_node(pts, 2 * node + 1, mid, hi);
+        }
+
+        template <typename F>
+        void visit(size_t node, size_t lo, size_t hi, double x, double y, double rad2, F& f) const {
+            if (hi - lo <= LEAF_SIZE) {
+                f(lo, hi);
+                return;
+            }
+            size_t mid = (lo + hi) / 2;
+            // left holds coordinates <= split, right >= split
+            double d = (axis[node] ? y : x) - split[node];
+            if (d <= 0 || d * d <= rad2) {
+                visit(2 * node, lo, mid, x, y, rad2, f);
+            }
+            if (d >= 0 || d * d <= rad2) {
+                visit(2 * node + 1, mid, hi, x, y, rad2, f);
+            }
+        }
+
+        void nearest_in(size_t node, size_t lo, size_t hi, double x, double y, size_t k) const {
+            if (hi - lo <= LEAF_SIZE) {
+                for (size_t p = lo; p < hi; ++p) {
+                    double dx = x - px[p];
+                    double dy = y - py[p];
+                    std::pair<double, uint32_t> candidate(dx * dx + dy * dy, order[p]);
+                    if (heap.size() < k) {
+                        heap.push_back(candidate);
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                    else if (candidate < heap.front()) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.back() = candidate;
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+                return;
+            }
+            size_t mid = (lo + hi) / 2;
+            double d = (axis[node] ? y : x) - split[node];
+            bool left_first = d <= 0;
+            for (int side = 0; side < 2; ++side) {
+                bool left = (side == 0) == left_first;
+                // the far side is only worth a look while it could beat the worst kept
+                if (side == 1 && heap.size() == k && d * d > heap.front().first) {
+                    return;
+                }
+                if (left) {
+                    nearest_in(2 * node, lo, mid, x, y, k);
+                }
+                else {
+                    nearest_in(2 * node + 1, mid, hi, x, y, k);
+                }
+            }
+        }
+
+        size_t count = 0;
+        std::vector<double> split;
+        std::vector<uint8_t> axis;
+        std::vector<uint32_t> order;
+        std::vector<double> px;
+        std::vector<double> py;
+        // kNN scratch, max-heap on (distance², index)
+        mutable std::vector<std::pair<double, uint32_t>> heap;
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file. An empty file maps to an
+// empty view.
+class MappedFile {
+    public:
+        explicit MappedFile(const char* filename) {
+            int fd = open(filename, O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("can't open file");
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                throw std::runtime_error("can't open file");
+            }
+            size = static_cast<size_t>(st.st_size);
+            if (size > 0) {
+                void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    close(fd);
+                    throw std::runtime_error("can't map file");
+                }
+                data = static_cast<const char*>(p);
+                madvise(p, size, MADV_SEQUENTIAL);
+            }
+            close(fd);
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() {
+            if (data) {
+                munmap(const_cast<char*>(data), size);
+            }
+        }
+        std::string_view view() const { return std::string_view(data ? data : "", size); }
+
+    private:
+        const char* data = nullptr;
+        size_t size = 0;
+};
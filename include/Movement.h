@@ -0,0 +1,71 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "NPC.h"
+#include "Simd.h"
+
+// Moves every NPC along its heading once per step, at the speed of its
+// kind, bouncing off the world borders. Positions are gathered into
+// contiguous columns, advanced by one MoveKernel call and written back;
+// only NPCs that actually moved become dirty. NPCs without a heading get a
+// random one, drawn in array order, so two stages with the same seed move
+// the same world the same way.
+class MovementStage {
+    public:
+        MovementStage() : MovementStage(std::random_device{}()) {}
+        explicit MovementStage(uint64_t seed) : gen(seed) {}
+
+        void set_speed(NPCKind kind, double speed) { speeds[static_cast<size_t>(kind)] = speed; }
+        double get_speed(NPCKind kind) const { return speeds[static_cast<size_t>(kind)]; }
+        void set_kernel(MoveKernel kernel) { move = kernel; }
+
+        void step(NPC_array& arr, double dt = 1.0) {
+            auto& npcs = arr.get_npcs();
+            size_t n = npcs.size();
+            x.resize(n);
+            y.resize(n);
+            vx.resize(n);
+            vy.resize(n);
+            steps.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                NPC& npc = *npcs[i];
+                steps[i] = get_speed(npc.get_kind()) * dt;
+                if (npc.get_vx() == 0 && npc.get_vy() == 0 && steps[i] != 0) {
+                    double angle = (gen() >> 11) * 0x1.0p-53 * 2 * M_PI;
+                    npc.set_velocity(std::cos(angle), std::sin(angle));
+                }
+                x[i] = npc.get_x_cord();
+                y[i] = npc.get_y_cord();
+                vx[i] = npc.get_vx();
+                vy[i] = npc.get_vy();
+            }
+            move(x.data(), y.data(), vx.data(), vy.data(), steps.data(), n, WORLD_SIZE);
+            for (size_t i = 0; i < n; ++i) {
+                NPC& npc = *npcs[i];
+                if (x[i] != npc.get_x_cord()) {
+                    npc.set_x(x[i]);
+                }
+                if (y[i] != npc.get_y_cord()) {
+                    npc.set_y(y[i]);
+                }
+                if (vx[i] != npc.get_vx() || vy[i] != npc.get_vy()) {
+                    // bounced
+                    npc.set_velocity(vx[i], vy[i]);
+                }
+            }
+        }
+
+    private:
+        // world units per unit of time; config kinds stand still until set
+        double speeds[KillRules::MAX_KINDS] = {0.0, 2.0, 1.5, 1.0};
+        std::mt19937_64 gen;
+        MoveKernel move = select_move_kernel();
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> vx;
+        std::vector<double> vy;
+        std::vector<double> steps;
+};
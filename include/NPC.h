@@ -1,128 +1,784 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <list>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <memory>
 #include <cstdio>
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include "Index.h"
+#include "MappedFile.h"
+#include "Names.h"
+#include "Rules.h"
+#include "Stats.h"
+#include "Pool.h"
+#include "Parser.h"
+#include "Snapshot.h"
+#include "TextWriter.h"
+#include "ThreadPool.h"
 
 #define MAX_LENGTH 256
 
+// Loaders accept coordinates in [0, WORLD_SIZE].
+constexpr double WORLD_SIZE = 500.0;
+
+// The built-in kinds; ids from NPC_KIND_COUNT on are kinds declared in
+// the active KillRules config.
+enum class NPCKind : uint8_t { npc, squirrel, werewolf, druid };
+
+// Same spelling as get_type() of the matching class.
+inline std::string_view kind_name(NPCKind kind) {
+    switch (kind) {
+        case NPCKind::squirrel: return "squirrel";
+        case NPCKind::werewolf: return "werewolf";
+        case NPCKind::druid: return "druid";
+        default: break;
+    }
+    size_t id = static_cast<size_t>(kind);
+    return id >= NPC_KIND_COUNT && id < active_rules().size() ? active_rules().name(id) : "NPC";
+}
+
 class NPC {
     public:
-        NPC() : x_cord(0), y_cord(0), is_alive(true) {}
-        NPC(const std::string& nam, double x, double y): name(nam), x_cord(x), y_cord(y), is_alive(true){}
-        NPC(const NPC& other) : name(other.name), x_cord(other.x_cord), y_cord(other.y_cord), is_alive(true) {}
+        NPC() : is_alive(true), x_cord(0), y_cord(0) {}
+        NPC(std::string_view nam, double x, double y): is_alive(true), x_cord(x), y_cord(y) { set_local_name(nam); }
+        NPC(const NPC& other) : kind(other.kind), is_alive(true), x_cord(other.x_cord), y_cord(other.y_cord),
+                                vx(other.vx), vy(other.vy) {
+            set_local_name(other.get_name());
+        }
+        // Takes over the name of other. A standalone other is left without a
+        // name; one moved out of an array still reads the array's table.
+        NPC(NPC&& other) noexcept : kind(other.kind), is_alive(other.is_alive), name_id(other.name_id),
+                                    x_cord(other.x_cord), y_cord(other.y_cord), vx(other.vx), vy(other.vy),
+                                    names(other.names), local_name(std::move(other.local_name)),
+                                    local_size(std::exchange(other.local_size, 0)) {}
         NPC& operator=(const NPC& other) {
             if (this != &other) {
-                name = other.name;
-                x_cord = other.x_cord;
-                y_cord = other.y_cord;
+                set_name(other.get_name());
+                set_x(other.x_cord);
+                set_y(other.y_cord);
+                set_velocity(other.vx, other.vy);
+                is_alive = other.is_alive;
+                changed = true;
+            }
+            return *this;
+        }
+        // An NPC inside an array interns the name instead, like copy assignment.
+        NPC& operator=(NPC&& other) {
+            if (this != &other) {
+                if (names) {
+                    set_name(other.get_name());
+                }
+                else {
+                    name_id = other.name_id;
+                    names = other.names;
+                    local_name = std::move(other.local_name);
+                    local_size = std::exchange(other.local_size, 0);
+                }
+                set_x(other.x_cord);
+                set_y(other.y_cord);
+                set_velocity(other.vx, other.vy);
                 is_alive = other.is_alive;
+                changed = true;
             }
             return *this;
         }
         bool operator==(const NPC& other) const {
-            return x_cord == other.x_cord && y_cord == other.y_cord && name == other.name && is_alive == other.is_alive;
+            return x_cord == other.x_cord && y_cord == other.y_cord && get_name() == other.get_name() && is_alive == other.is_alive;
+        }
+        void set_x(double x) {
+            x_cord = x;
+            dirty = true;
+            changed = true;
+            if (index) {
+                index->invalidate();
+            }
+        }
+        void set_y(double y) {
+            y_cord = y;
+            dirty = true;
+            changed = true;
+            if (index) {
+                index->invalidate();
+            }
+        }
+        void set_name(std::string_view nam) {
+            changed = true;
+            if (names) {
+                name_id = names->intern(nam);
+                if (index) {
+                    index->invalidate();
+                }
+            }
+            else {
+                set_local_name(nam);
+            }
+        }
+        // Heading used by the movement stage, in world units per unit of speed.
+        void set_velocity(double x, double y) {
+            vx = x;
+            vy = y;
+            changed = true;
         }
-        void set_x(double x) { x_cord = x; }
-        void set_y(double y) { y_cord = y; }
-        void set_name(const std::string& nam) { name = nam; }
+        double get_vx() const { return vx; }
+        double get_vy() const { return vy; }
         double get_x_cord() const { return x_cord; }
         double get_y_cord() const { return y_cord; }
-        void kill_npc() { is_alive = false; }
-        bool is_alive_NPC() { return is_alive;}
-        std::string get_name() const { return name; }
+        void kill_npc() {
+            is_alive = false;
+            changed = true;
+        }
+        bool is_alive_NPC() const { return is_alive;}
+        // Views into the name table of the owning NPC_array (valid while the
+        // array lives) or into the NPC itself when it is not in an array.
+        std::string_view get_name() const {
+            return names ? names->get(name_id) : std::string_view(local_name.get(), local_size);
+        }
+        // Id in the owning array's name table, NameTable::NO_NAME outside an array.
+        uint32_t get_name_id() const { return names ? name_id : NameTable::NO_NAME; }
+        NPCKind get_kind() const { return kind; }
+        // Set when the NPC moved or joined an array since the last combat
+        // round that looked at it.
+        bool is_dirty() const { return dirty; }
+        void mark_clean() { dirty = false; }
         virtual std::string get_type() const { return "NPC"; }
         virtual ~NPC() noexcept = default;
+
+    protected:
+        NPC(NPCKind k, std::string_view nam, double x, double y) : NPC(nam, x, y) { kind = k; }
         
     private:
+        friend class NPC_array;
+
+        void set_local_name(std::string_view nam) {
+            local_name = nam.empty() ? nullptr : std::make_unique<char[]>(nam.size());
+            std::copy(nam.begin(), nam.end(), local_name.get());
+            local_size = static_cast<uint32_t>(nam.size());
+        }
+        void bind_names(NameTable* table, uint32_t id) {
+            names = table;
+            name_id = id;
+            local_name.reset();
+            local_size = 0;
+        }
+
+        NPCKind kind = NPCKind::npc;
         bool is_alive;
+        bool dirty = true;
+        bool changed = true;  // since the owning array's last snapshot or restore
+        uint32_t name_id = NameTable::NO_NAME;
         double x_cord;
         double y_cord;
-        std::string name;
+        double vx = 0;
+        double vy = 0;
+        NameTable* names = nullptr;
+        NPCIndex* index = nullptr;
+        std::unique_ptr<char[]> local_name;
+        uint32_t local_size = 0;
+        uint32_t stamp = 0;  // identity within the owning array, kept by restores
+};
+
+// Owner of a heap-allocated NPC has a null pool; NPCs built inside an
+// NPC_array live in one of its slot pools and go back there.
+struct NPCDeleter {
+    SlotPool* pool = nullptr;
+    void operator()(NPC* npc) const {
+        if (!pool) {
+            delete npc;
+            return;
+        }
+        npc->~NPC();
+        pool->release(npc);
+    }
+};
+
+using NPC_ptr = std::unique_ptr<NPC, NPCDeleter>;
+
+// NPC of a kind declared in the kill-rule config rather than in code.
+class creature: public NPC {
+    public:
+        creature(NPCKind kind, std::string_view nam, double x, double y) : NPC(kind, nam, x, y) {}
+        std::string get_type() const override { return std::string(kind_name(get_kind())); }
+};
+
+class squirrel: public NPC {
+    public:
+        static constexpr NPCKind KIND = NPCKind::squirrel;
+
+        squirrel() : NPC(NPCKind::squirrel, "", 0, 0) {}
+        squirrel(std::string_view nam, double x, double y) : NPC(NPCKind::squirrel, nam, x, y) {}
+        std::string get_type() const override { return "squirrel"; }
+};
+
+class werewolf: public NPC {
+    public:
+        static constexpr NPCKind KIND = NPCKind::werewolf;
+
+        werewolf() : NPC(NPCKind::werewolf, "", 0, 0) {}
+        werewolf(std::string_view nam, double x, double y) : NPC(NPCKind::werewolf, nam, x, y) {}
+        std::string get_type() const override { return "werewolf"; }
+};
+
+class druid: public NPC {
+    public:
+        static constexpr NPCKind KIND = NPCKind::druid;
+
+        druid() : NPC(NPCKind::druid, "", 0, 0) {}
+        druid(std::string_view nam, double x, double y) : NPC(NPCKind::druid, nam, x, y) {}
+        std::string get_type() const override { return "druid"; }
+};
+
+// Copy-on-write image of an NPC_array, taken by NPC_array::snapshot().
+// The records are split into chunks of up to CHUNK_SIZE NPCs, immutable
+// once taken; a snapshot shares every chunk whose NPCs have not changed
+// since the array's previous snapshot or restore, so taking one copies
+// only what changed. Name ids refer to the array's name table.
+class WorldSnapshot {
+    public:
+        static constexpr size_t CHUNK_SIZE = 4096;
+
+        struct Record {
+            uint32_t stamp;
+            uint32_t name_id;
+            NPCKind kind;
+            bool alive;
+            double x, y;
+            double vx, vy;
+        };
+        using Chunk = std::vector<Record>;
+
+        size_t size() const { return count; }
+        const std::vector<std::shared_ptr<const Chunk>>& get_chunks() const { return chunks; }
+
+    private:
+        friend class NPC_array;
+
+        std::vector<std::shared_ptr<const Chunk>> chunks;
+        size_t count = 0;
+        uint64_t owner = 0;
 };
 
 class NPC_array {
     public:
-        size_t get_size() const { return array.size(); }
+        NPC_array() = default;
+        // The moved-from array is left empty but usable: it gets fresh
+        // tables, or the target's old ones once they are cleared.
+        NPC_array(NPC_array&& other) { swap(other); }
+        NPC_array& operator=(NPC_array&& other) noexcept {
+            if (this != &other) {
+                swap(other);
+                other.clear();
+            }
+            return *this;
+        }
+        // Names, pools and index are heap-held, so the NPCs keep pointing
+        // into the tables that move with them.
+        void swap(NPC_array& other) noexcept {
+            std::swap(names, other.names);
+            for (size_t k = 0; k < NPC_KIND_COUNT; ++k) {
+                std::swap(pools[k], other.pools[k]);
+            }
+            std::swap(index, other.index);
+            std::swap(array, other.array);
+            std::swap(holes, other.holes);
+            std::swap(settled_radius, other.settled_radius);
+            std::swap(settled_rules, other.settled_rules);
+            std::swap(base, other.base);
+            std::swap(next_stamp, other.next_stamp);
+            std::swap(id, other.id);
+        }
+        size_t get_size() const { return array.size() - holes; }
+        void reserve(size_t count) { array.reserve(count); }
         void add_NPC(std::unique_ptr<NPC>&& npc) {
-            array.push_back(std::move(npc));
+            add_NPC(NPC_ptr(npc.release()));
+        }
+        void add_NPC(NPC_ptr&& npc) {
+            npc->bind_names(names.get(), names->intern(npc->get_name()));
+            push(std::move(npc));
+        }
+        // Builds the NPC in the per-kind pool of this array: no heap
+        // allocation per object, and slots of dead NPCs are reused. Pooled
+        // NPCs must not be moved into a container that outlives the array.
+        NPC& emplace_npc(NPCKind kind, std::string_view name, double x, double y) {
+            return emplace_npc(kind, names->intern(name), x, y);
+        }
+        NPC& emplace_npc(NPCKind kind, uint32_t name_id, double x, double y) {
+            push(construct(kind, name_id, x, y));
+            return *array.back();
+        }
+        const NameTable& get_names() const { return *names; }
+        NameTable& get_names() { return *names; }
+        // Keeps hash indexes from name id and from exact position to slots,
+        // so remove_npc and remove_at no longer scan the array. Removed NPCs
+        // leave holes that the next get_npcs() or erase_dead() closes; the
+        // indexes are rebuilt on the first lookup after that, or after an
+        // NPC changed its name or position.
+        void set_indexed(bool on) {
+            if (on == static_cast<bool>(index)) {
+                return;
+            }
+            compact();
+            index = on ? std::make_unique<NPCIndex>() : nullptr;
+            for (auto& npc : array) {
+                npc->index = index.get();
+            }
+        }
+        bool is_indexed() const { return static_cast<bool>(index); }
+        // Radius of the last completed combat round. Until an NPC is added
+        // or moves, no pair of NPCs within that radius can fight, so the
+        // next round at the same radius only has to look at dirty NPCs.
+        // NaN when there was no such round.
+        double get_settled_radius() const { return settled_radius; }
+        // Id of the KillRules that round used; other rules may still fight.
+        uint64_t get_settled_rules() const { return settled_rules; }
+        void set_settled_radius(double rad, uint64_t rules_id = 0) {
+            settled_radius = rad;
+            settled_rules = rules_id;
         }
         void remove_at(double x, double y) {
-            array.remove_if([x, y](const std::unique_ptr<NPC>& npc) {
+            if (index) {
+                if (std::isnan(x) || std::isnan(y)) {
+                    return;
+                }
+                refresh_index();
+                for (uint32_t slot = index->by_coords.take(CoordKey::of(x, y)); slot != NPCIndex::NONE;
+                     slot = index->by_coords.next_of(slot)) {
+                    release(slot);
+                }
+                return;
+            }
+            std::erase_if(array, [x, y](const NPC_ptr& npc) {
                 return npc->get_x_cord() == x && npc->get_y_cord() == y;
             });
         }
-        void remove_npc(const std::string& name) {
-            array.remove_if([&name](const std::unique_ptr<NPC>& npc) {
-                return npc->get_name() == name;
+        void remove_npc(std::string_view name) {
+            uint32_t id = names->find(name);
+            if (id != NameTable::NO_NAME) {
+                remove_npc_id(id);
+            }
+        }
+        void remove_npc_id(uint32_t name_id) {
+            if (index) {
+                refresh_index();
+                for (uint32_t slot = index->by_name.take(name_id); slot != NPCIndex::NONE;
+                     slot = index->by_name.next_of(slot)) {
+                    release(slot);
+                }
+                return;
+            }
+            std::erase_if(array, [name_id](const NPC_ptr& npc) {
+                return npc->get_name_id() == name_id;
             });
         }
-        std::list<std::unique_ptr<NPC>>& get_npcs() {
+        // Drops every NPC whose alive flag is cleared, keeping the order of
+        // the survivors. Returns the number of removed NPCs.
+        size_t erase_dead() {
+            size_t removed = std::erase_if(array, [](const NPC_ptr& npc) {
+                return !npc || !npc->is_alive_NPC();
+            }) - holes;
+            closed_holes();
+            return removed;
+        }
+        // Drops the first count NPCs, keeping the order of the rest.
+        void erase_front(size_t count) {
+            compact();
+            array.erase(array.begin(), array.begin() + std::min(count, array.size()));
+            closed_holes();
+        }
+        std::vector<NPC_ptr>& get_npcs() {
+            compact();
             return array;
         }
-        const std::list<std::unique_ptr<NPC>>& get_npcs() const {
+        const std::vector<NPC_ptr>& get_npcs() const {
+            compact();
             return array;
         }
         void print_all() const {
-            for (const auto& npc : array) {
+            for (const auto& npc : get_npcs()) {
                 std::cout << npc->get_type() << " " << npc->get_name() << " " 
                         << npc->get_x_cord() << " " << npc->get_y_cord() << "\n";
             }
         }
+        // Hands the pool chunks back in one go. Pooled NPCs keep their
+        // names in the name table and own nothing outside their slot, so
+        // they are dropped with the chunks instead of destroyed one by one;
+        // only NPCs added from the heap are deleted.
         void clear() {
+            for (auto& npc : array) {
+                if (npc && npc.get_deleter().pool) {
+                    (void)npc.release();
+                }
+            }
             array.clear();
+            closed_holes();
+            settled_radius = std::nan("");
+            base.clear();
+            id = new_id();
+            if (names) {
+                names->clear();
+            }
+            for (auto& pool : pools) {
+                if (pool) {
+                    pool->reset();
+                }
+            }
+        }
+        // Cheap copy of the world to come back to with restore(): NPCs,
+        // positions, headings and liveness. Walks the array once and copies
+        // only the chunks that changed since the last snapshot or restore.
+        // restore() rebuilds removed NPCs from their kind, so an array
+        // holding other NPC subclasses (added through add_NPC) can't be
+        // snapshotted.
+        WorldSnapshot snapshot() {
+            compact();
+            WorldSnapshot snap;
+            snap.owner = id;
+            snap.count = array.size();
+            std::vector<std::pair<size_t, size_t>> captured;
+            size_t p = 0;
+            try {
+                // the array is in stamp order, and each base chunk covers a
+                // stamp range: same count in the range means the same NPCs
+                for (const auto& chunk : base) {
+                    uint32_t last = chunk->back().stamp;
+                    size_t first = p;
+                    bool clean = true;
+                    for (; p < array.size() && array[p]->stamp <= last; ++p) {
+                        clean &= !array[p]->changed;
+                    }
+                    if (clean && p - first == chunk->size()) {
+                        snap.chunks.push_back(chunk);
+                    }
+                    else if (p > first) {
+                        snap.chunks.push_back(capture(first, p));
+                        captured.emplace_back(first, p);
+                    }
+                }
+                for (; p < array.size(); p += WorldSnapshot::CHUNK_SIZE) {
+                    size_t last = std::min(array.size(), p + WorldSnapshot::CHUNK_SIZE);
+                    snap.chunks.push_back(capture(p, last));
+                    captured.emplace_back(p, last);
+                }
+            } catch (...) {
+                // base stays, so what was captured is changed against it
+                for (auto [first, last] : captured) {
+                    for (size_t k = first; k < last; ++k) {
+                        array[k]->changed = true;
+                    }
+                }
+                throw;
+            }
+            base = snap.chunks;
+            return snap;
+        }
+        // Brings the array back to a snapshot of it, in any order and any
+        // number of times. NPCs that still exist are reset in place, and
+        // only if they changed or their chunk is not shared with the last
+        // snapshot; the ones removed since are rebuilt, in the pools. The
+        // next combat round runs in full.
+        void restore(const WorldSnapshot& snap) {
+            if (snap.owner != id) {
+                throw std::logic_error("snapshot of another array");
+            }
+            compact();
+            std::vector<NPC_ptr> restored;
+            restored.reserve(snap.count);
+            size_t p = 0;
+            size_t b = 0;
+            for (const auto& chunk : snap.chunks) {
+                while (b < base.size() && base[b]->back().stamp < chunk->front().stamp) {
+                    ++b;
+                }
+                // clean NPCs of a shared chunk still hold its records
+                bool shared = b < base.size() && base[b] == chunk;
+                size_t n = chunk->size();
+                if (shared && p + n <= array.size() && array[p]->stamp == chunk->front().stamp
+                    && array[p + n - 1]->stamp == chunk->back().stamp) {
+                    // the whole chunk is still there, in order
+                    for (size_t k = 0; k < n; ++k, ++p) {
+                        if (array[p]->changed) {
+                            reset(*array[p], (*chunk)[k]);
+                        }
+                        restored.push_back(std::move(array[p]));
+                    }
+                    continue;
+                }
+                for (const auto& rec : *chunk) {
+                    while (p < array.size() && array[p]->stamp < rec.stamp) {
+                        array[p++].reset();
+                    }
+                    if (p < array.size() && array[p]->stamp == rec.stamp) {
+                        NPC& npc = *array[p];
+                        if (!shared || npc.changed) {
+                            reset(npc, rec);
+                        }
+                        restored.push_back(std::move(array[p++]));
+                    }
+                    else {
+                        restored.push_back(construct(rec.kind, rec.name_id, rec.x, rec.y));
+                        NPC& npc = *restored.back();
+                        npc.stamp = rec.stamp;
+                        npc.index = index.get();
+                        reset(npc, rec);
+                    }
+                }
+            }
+            array.clear();
+            array = std::move(restored);
+            base = snap.chunks;
+            settled_radius = std::nan("");
+            closed_holes();
+        }
+        size_t get_pool_chunks() const {
+            size_t chunks = 0;
+            for (auto& pool : pools) {
+                chunks += pool ? pool->get_chunk_count() : 0;
+            }
+            return chunks;
         }
     private:
-        std::list<std::unique_ptr<NPC>> array;
-};
-
-class squirrel: public NPC {
-    public:
-        squirrel() : NPC() {}
-        squirrel(const std::string& nam, double x, double y) : NPC(nam, x, y) {}
-        std::string get_type() const override { return "squirrel"; }
-};
-
-class werewolf: public NPC {
-    public:
-        werewolf() : NPC() {}
-        werewolf(const std::string& nam, double x, double y) : NPC(nam, x, y) {}
-        std::string get_type() const override { return "werewolf"; }
-};
+        static uint64_t new_id() {
+            static std::atomic<uint64_t> next_id{1};
+            return next_id++;
+        }
+        NPC_ptr construct(NPCKind kind, uint32_t name_id, double x, double y) {
+            switch (kind) {
+                case NPCKind::squirrel: return construct<squirrel>(kind, name_id, x, y);
+                case NPCKind::werewolf: return construct<werewolf>(kind, name_id, x, y);
+                case NPCKind::druid: return construct<druid>(kind, name_id, x, y);
+                case NPCKind::npc: return construct<NPC>(kind, name_id, x, y);
+                default: return construct<creature>(kind, name_id, x, y);
+            }
+        }
+        template <typename T>
+        NPC_ptr construct(NPCKind kind, uint32_t name_id, double x, double y) {
+            // creatures are plain NPCs in size and share their pool
+            size_t k = static_cast<size_t>(kind);
+            SlotPool& pool = *pools[k < NPC_KIND_COUNT ? k : 0];
+            T* npc;
+            if constexpr (std::is_same_v<T, creature>) {
+                npc = new (pool.allocate()) T(kind, "", x, y);
+            }
+            else {
+                npc = new (pool.allocate()) T("", x, y);
+            }
+            npc->bind_names(names.get(), name_id);
+            return NPC_ptr(npc, NPCDeleter{&pool});
+        }
+        void push(NPC_ptr&& npc) {
+            npc->index = index.get();
+            npc->dirty = true;
+            npc->changed = true;
+            npc->stamp = next_stamp++;
+            array.push_back(std::move(npc));
+            if (index && !index->stale) {
+                const NPC& added = *array.back();
+                uint32_t slot = static_cast<uint32_t>(array.size() - 1);
+                index->by_name.insert(added.name_id, slot);
+                index->by_coords.insert(CoordKey::of(added.x_cord, added.y_cord), slot);
+            }
+        }
+        void release(uint32_t slot) {
+            if (array[slot]) {
+                array[slot].reset();
+                ++holes;
+            }
+        }
+        void refresh_index() {
+            if (!index->stale) {
+                return;
+            }
+            index->by_name.clear();
+            index->by_coords.clear();
+            index->by_name.reserve(array.size());
+            index->by_coords.reserve(array.size());
+            for (uint32_t slot = 0; slot < array.size(); ++slot) {
+                if (const NPC* npc = array[slot].get()) {
+                    index->by_name.insert(npc->name_id, slot);
+                    index->by_coords.insert(CoordKey::of(npc->x_cord, npc->y_cord), slot);
+                }
+            }
+            index->stale = false;
+        }
+        // Slots shift, so the indexes go stale.
+        void compact() const {
+            if (holes) {
+                std::erase_if(array, [](const NPC_ptr& npc) { return !npc; });
+                closed_holes();
+            }
+        }
+        // Whether construct() gives back the same type.
+        static bool rebuildable(const NPC& npc) {
+            const std::type_info& type = typeid(npc);
+            switch (npc.kind) {
+                case NPCKind::squirrel: return type == typeid(squirrel);
+                case NPCKind::werewolf: return type == typeid(werewolf);
+                case NPCKind::druid: return type == typeid(druid);
+                case NPCKind::npc: return type == typeid(NPC);
+                default: return type == typeid(creature);
+            }
+        }
+        std::shared_ptr<const WorldSnapshot::Chunk> capture(size_t first, size_t last) {
+            auto chunk = std::make_shared<WorldSnapshot::Chunk>();
+            chunk->reserve(last - first);
+            for (size_t p = first; p < last; ++p) {
+                const NPC& npc = *array[p];
+                // pooled NPCs were built by construct(); clean ones passed
+                // this check when they were captured
+                if (!array[p].get_deleter().pool && !rebuildable(npc)) {
+                    throw std::logic_error("can't snapshot NPC type " + npc.get_type());
+                }
+                chunk->push_back({npc.stamp, npc.name_id, npc.kind, npc.is_alive,
+                                  npc.x_cord, npc.y_cord, npc.vx, npc.vy});
+            }
+            for (size_t p = first; p < last; ++p) {
+                array[p]->changed = false;
+            }
+            return chunk;
+        }
+        static void reset(NPC& npc, const WorldSnapshot::Record& rec) {
+            if (npc.x_cord != rec.x || npc.y_cord != rec.y) {
+                npc.x_cord = rec.x;
+                npc.y_cord = rec.y;
+                npc.dirty = true;
+            }
+            npc.vx = rec.vx;
+            npc.vy = rec.vy;
+            npc.name_id = rec.name_id;
+            npc.is_alive = rec.alive;
+            npc.changed = false;
+        }
+        void closed_holes() const {
+            holes = 0;
+            if (index) {
+                index->invalidate();
+            }
+        }
 
-class druid: public NPC {
-    public:
-        druid() : NPC() {}
-        druid(const std::string& nam, double x, double y) : NPC(nam, x, y) {}
-        std::string get_type() const override { return "druid"; }
+        // names, pools and index are heap-held so moving the array keeps the
+        // NPCs' pointers valid, and declared first so they outlive the NPCs.
+        // names keeps the names of removed NPCs until clear() (see Names.h).
+        std::unique_ptr<NameTable> names = std::make_unique<NameTable>();
+        std::unique_ptr<SlotPool> pools[NPC_KIND_COUNT] = {
+            std::make_unique<SlotPool>(sizeof(NPC)),
+            std::make_unique<SlotPool>(sizeof(squirrel)),
+            std::make_unique<SlotPool>(sizeof(werewolf)),
+            std::make_unique<SlotPool>(sizeof(druid)),
+        };
+        std::unique_ptr<NPCIndex> index;
+        // holes are slots emptied by indexed removals; const readers close
+        // them before handing out the vector
+        mutable std::vector<NPC_ptr> array;
+        mutable size_t holes = 0;
+        double settled_radius = std::nan("");
+        uint64_t settled_rules = 0;
+        // chunks of the last snapshot or restore, which clean NPCs still match
+        std::vector<std::shared_ptr<const WorldSnapshot::Chunk>> base;
+        uint32_t next_stamp = 0;
+        uint64_t id = new_id();
 };
 
-
 class NPCFactory {
-    public:
-        static std::unique_ptr<NPC> create_npc(const std::string& npc_type, 
-                                            const std::string& name, 
-                                            double x, double y) {
-            if (npc_type == "squirrel") {
-                return std::make_unique<squirrel>(name, x, y);
+    private:
+        struct ParsedChunk {
+            enum Status { clean, incomplete, malformed };
+            struct Pending {
+                NPCKind kind;
+                std::string_view name;
+                double x, y;
+            };
+            std::vector<Pending> npcs;
+            std::vector<std::pair<int, std::string>> errors;
+            int records = 0;
+            Status status = clean;
+            size_t tail = 0;
+        };
+
+        // Parses text as if it started at a record boundary. Errors keep
+        // chunk-local record numbers until the chunk is appended.
+        static void parse_chunk(std::string_view text, ParsedChunk& out) {
+            NPCRecordParser parser(text);
+            NPCRecord rec;
+            char message[MAX_LENGTH + 64];
+            while (true) {
+                const char* start = parser.position();
+                if (!parser.next(rec)) {
+                    if (!parser.at_end()) {
+                        out.status = ParsedChunk::malformed;
+                    }
+                    else if (!NPCRecordParser::is_blank(std::string_view(start, text.data() + text.size() - start))) {
+                        out.status = ParsedChunk::incomplete;
+                        out.tail = start - text.data();
+                    }
+                    return;
+                }
+                out.records++;
+                if (rec.x < 0 || rec.x > WORLD_SIZE || rec.y < 0 || rec.y > WORLD_SIZE) {
+                    snprintf(message, sizeof(message), "invalid NPC coords (%.2f, %.2f)", rec.x, rec.y);
+                    out.errors.emplace_back(out.records, message);
+                    continue;
+                }
+                try {
+                    out.npcs.push_back({kind_of(rec.type), rec.name, rec.x, rec.y});
+                } catch (const std::exception& e) {
+                    out.errors.emplace_back(out.records, std::string("error creating NPC: ") + e.what());
+                }
             }
-            else if (npc_type == "werewolf") {
-                return std::make_unique<werewolf>(name, x, y);
+        }
+        static void append_chunk(ParsedChunk& chunk, NPC_array& arr, int& line_number) {
+            if constexpr (STATS_ENABLED) {
+                load_stats.records += chunk.records;
+                load_stats.loaded += chunk.npcs.size();
+                load_stats.rejected += chunk.errors.size();
             }
-            else if (npc_type == "druid") {
-                return std::make_unique<druid>(name, x, y);
+            for (auto& [line, message] : chunk.errors) {
+                fprintf(stderr, "Line %d: %s\n", line_number + line, message.c_str());
             }
-            else {
-                throw std::logic_error("invalid NPC type: " + npc_type);
+            for (auto& npc : chunk.npcs) {
+                arr.emplace_npc(npc.kind, npc.name, npc.x, npc.y);
+            }
+            line_number += chunk.records;
+        }
+        static void count_record(bool loaded) {
+            if constexpr (STATS_ENABLED) {
+                load_stats.records++;
+                (loaded ? load_stats.loaded : load_stats.rejected)++;
+            }
+        }
+
+        static inline thread_local LoadStats load_stats;
+
+    public:
+        // Stats of the last load on this thread; zero unless built with
+        // NPC_STATS=1.
+        static const LoadStats& get_load_stats() { return load_stats; }
+        // Any kind of the active rules but the plain NPC.
+        static NPCKind kind_of(std::string_view npc_type) {
+            size_t kind = active_rules().find(npc_type);
+            if (kind == KillRules::NO_KIND || kind == static_cast<size_t>(NPCKind::npc)) {
+                throw std::logic_error("invalid NPC type: " + std::string(npc_type));
             }
+            return static_cast<NPCKind>(kind);
+        }
+        static std::unique_ptr<NPC> create_npc(std::string_view npc_type, 
+                                            std::string_view name, 
+                                            double x, double y) {
+            return create_npc(kind_of(npc_type), name, x, y);
         }
         static void load_from_file_c_style(const char* filename, NPC_array& arr) {
+            load_stats = LoadStats{};
+            PhaseTimer timer(load_stats.total_ns);
             FILE* file = fopen(filename, "r");
             if (!file) {
                 throw std::runtime_error("can't open file");
@@ -133,36 +789,292 @@ class NPCFactory {
             int line_number = 0;
             while (fscanf(file, "%255s %255s %lf %lf", type, name, &x, &y) == 4) {
                 line_number++;
-                if (x < 0 || x > 500 || y < 0 || y > 500) {
+                if (x < 0 || x > WORLD_SIZE || y < 0 || y > WORLD_SIZE) {
                     fprintf(stderr, "Line %d: invalid NPC coords (%.2f, %.2f)\n", 
                             line_number, x, y);
+                    count_record(false);
                     continue;
                 }
                 try {
-                    std::string type_str(type);
-                    std::string name_str(name);
-                    auto npc = create_npc(type_str, name_str, x, y);
-                    arr.add_NPC(std::move(npc));
+                    arr.emplace_npc(kind_of(type), name, x, y);
+                    count_record(true);
                 } catch (const std::exception& e) {
                     fprintf(stderr, "Line %d: error creating NPC: %s\n", 
                             line_number, e.what());
+                    count_record(false);
                 }
             }
+            if constexpr (STATS_ENABLED) {
+                load_stats.bytes = ftell(file);
+            }
             fclose(file);
         }
-        static void save_to_file(const char* filename, NPC_array& arr) {
-            FILE* file = fopen(filename, "w");
+        // Same records, diagnostics and result as load_from_file_c_style, but
+        // the file is mapped and tokenized in place.
+        static void load_from_file_mmap(const char* filename, NPC_array& arr) {
+            load_stats = LoadStats{};
+            PhaseTimer timer(load_stats.total_ns);
+            MappedFile file(filename);
+            std::string_view text = file.view();
+            if constexpr (STATS_ENABLED) {
+                load_stats.bytes = text.size();
+            }
+            arr.reserve(arr.get_size() + std::count(text.begin(), text.end(), '\n') + 1);
+            NPCRecordParser parser(text);
+            NPCRecord rec;
+            int line_number = 0;
+            while (parser.next(rec)) {
+                line_number++;
+                if (rec.x < 0 || rec.x > WORLD_SIZE || rec.y < 0 || rec.y > WORLD_SIZE) {
+                    fprintf(stderr, "Line %d: invalid NPC coords (%.2f, %.2f)\n", 
+                            line_number, rec.x, rec.y);
+                    count_record(false);
+                    continue;
+                }
+                try {
+                    arr.emplace_npc(kind_of(rec.type), rec.name, rec.x, rec.y);
+                    count_record(true);
+                } catch (const std::exception& e) {
+                    fprintf(stderr, "Line %d: error creating NPC: %s\n", 
+                            line_number, e.what());
+                    count_record(false);
+                }
+            }
+        }
+        // Splits the mapped file at newlines into chunks that are parsed and
+        // turned into NPCs on a thread pool, then appends them in file order.
+        // A record may span lines, so a chunk that ends inside a record
+        // hands the rest of the file to a sequential pass. NPC order, line
+        // numbers and diagnostics are those of load_from_file_c_style.
+        static void load_from_file_parallel(const char* filename, NPC_array& arr, size_t threads = 0,
+                                            size_t min_chunk_bytes = 1 << 20) {
+            load_stats = LoadStats{};
+            PhaseTimer timer(load_stats.total_ns);
+            MappedFile file(filename);
+            std::string_view text = file.view();
+            if constexpr (STATS_ENABLED) {
+                load_stats.bytes = text.size();
+            }
+            if (threads == 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            std::vector<std::string_view> pieces;
+            size_t chunk = std::max<size_t>(min_chunk_bytes, text.size() / (threads * 4) + 1);
+            for (size_t begin = 0; begin < text.size();) {
+                size_t end = std::min(text.size(), begin + chunk);
+                size_t newline = text.find('\n', end == 0 ? 0 : end - 1);
+                end = newline == std::string_view::npos ? text.size() : newline + 1;
+                pieces.push_back(text.substr(begin, end - begin));
+                begin = end;
+            }
+            std::vector<ParsedChunk> parsed(pieces.size());
+            std::atomic<size_t> next_piece{0};
+            {
+                PhaseTimer parse_timer(load_stats.parse_ns);
+                ThreadPool pool(std::min(threads, std::max<size_t>(pieces.size(), 1)));
+                pool.run([&](size_t) {
+                    for (size_t k; (k = next_piece++) < pieces.size();) {
+                        parse_chunk(pieces[k], parsed[k]);
+                    }
+                });
+            }
+            PhaseTimer build_timer(load_stats.build_ns);
+            size_t total = arr.get_size();
+            for (auto& chunk : parsed) {
+                total += chunk.npcs.size();
+            }
+            arr.reserve(total);
+            int line_number = 0;
+            for (size_t k = 0; k < parsed.size(); ++k) {
+                append_chunk(parsed[k], arr, line_number);
+                if (parsed[k].status == ParsedChunk::malformed) {
+                    return;
+                }
+                if (parsed[k].status == ParsedChunk::incomplete) {
+                    size_t offset = pieces[k].data() - text.data() + parsed[k].tail;
+                    ParsedChunk rest;
+                    parse_chunk(text.substr(offset), rest);
+                    append_chunk(rest, arr, line_number);
+                    return;
+                }
+            }
+        }
+        static std::unique_ptr<NPC> create_npc(NPCKind kind, std::string_view name, double x, double y) {
+            switch (kind) {
+                case NPCKind::squirrel: return std::make_unique<squirrel>(name, x, y);
+                case NPCKind::werewolf: return std::make_unique<werewolf>(name, x, y);
+                case NPCKind::druid: return std::make_unique<druid>(name, x, y);
+                case NPCKind::npc: return std::make_unique<NPC>(name, x, y);
+                default: break;
+            }
+            if (static_cast<size_t>(kind) >= active_rules().size()) {
+                throw std::logic_error("invalid NPC kind: " + std::to_string(static_cast<int>(kind)));
+            }
+            return std::make_unique<creature>(kind, name, x, y);
+        }
+        // Writes the array as a binary snapshot (see Snapshot.h); coordinates
+        // round-trip bit exact. The string table is the array's name table,
+        // so every distinct name is written once (names of removed NPCs
+        // included), and the kind table names the kinds of the active rules.
+        static void save_binary(const char* filename, const NPC_array& arr) {
+            SnapshotHeader header{};
+            header.count = arr.get_size();
+            std::vector<uint8_t> kinds;
+            std::vector<double> xs, ys;
+            std::vector<uint32_t> name_ids;
+            std::vector<uint64_t> offsets{0};
+            std::string chars;
+            const NameTable& names = arr.get_names();
+            kinds.reserve(header.count);
+            xs.reserve(header.count);
+            ys.reserve(header.count);
+            name_ids.reserve(header.count);
+            offsets.reserve(names.size() + 1);
+            for (const auto& npc : arr.get_npcs()) {
+                kinds.push_back(static_cast<uint8_t>(npc->get_kind()));
+                xs.push_back(npc->get_x_cord());
+                ys.push_back(npc->get_y_cord());
+                name_ids.push_back(npc->get_name_id());
+            }
+            for (uint32_t id = 0; id < names.size(); ++id) {
+                chars += names.get(id);
+                offsets.push_back(chars.size());
+            }
+            header.names = offsets.size() - 1;
+            header.string_bytes = offsets.back();
+            std::vector<uint64_t> kind_offsets{0};
+            std::string kind_chars;
+            for (size_t kind = 0; kind < active_rules().size(); ++kind) {
+                kind_chars += active_rules().name(kind);
+                kind_offsets.push_back(kind_chars.size());
+            }
+            header.kinds = kind_offsets.size() - 1;
+            header.kind_bytes = kind_offsets.back();
+            snapshot_layout(header);
+
+            FILE* file = fopen(filename, "wb");
             if (!file) {
                 throw std::runtime_error("can't open file");
             }
-            for (auto& npc : arr.get_npcs()) {
-                fprintf(file, "%s %s %lf %lf\n", 
-                        npc->get_type().c_str(), 
-                        npc->get_name().c_str(),
-                        npc->get_x_cord(), 
-                        npc->get_y_cord());
+            auto section = [&](uint64_t offset, const void* data, size_t bytes) {
+                static const char zeros[8] = {};
+                long pos = ftell(file);
+                fwrite(zeros, 1, offset - static_cast<uint64_t>(pos), file);
+                fwrite(data, 1, bytes, file);
+            };
+            fwrite(&header, sizeof(header), 1, file);
+            section(header.kinds_offset, kinds.data(), kinds.size());
+            section(header.x_offset, xs.data(), xs.size() * sizeof(double));
+            section(header.y_offset, ys.data(), ys.size() * sizeof(double));
+            section(header.name_ids_offset, name_ids.data(), name_ids.size() * sizeof(uint32_t));
+            section(header.offsets_offset, offsets.data(), offsets.size() * sizeof(uint64_t));
+            section(header.chars_offset, chars.data(), chars.size());
+            section(header.kind_offsets_offset, kind_offsets.data(), kind_offsets.size() * sizeof(uint64_t));
+            section(header.kind_chars_offset, kind_chars.data(), kind_chars.size());
+            bool ok = !ferror(file);
+            ok = fclose(file) == 0 && ok;
+            if (!ok) {
+                throw std::runtime_error("can't write file");
             }
-            fclose(file);
+        }
+        // Maps a snapshot and appends its NPCs to arr; columns are read in
+        // place, nothing is parsed per record. Kinds are matched by name
+        // against the active rules; an NPC of a kind they lack rejects the
+        // file.
+        static void load_binary(const char* filename, NPC_array& arr) {
+            load_stats = LoadStats{};
+            PhaseTimer timer(load_stats.total_ns);
+            MappedFile file(filename);
+            std::string_view data = file.view();
+            SnapshotHeader header;
+            if (data.size() < sizeof(header)) {
+                throw std::runtime_error("invalid snapshot: truncated header");
+            }
+            std::memcpy(&header, data.data(), sizeof(header));
+            if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+                throw std::runtime_error("invalid snapshot: bad magic");
+            }
+            if (header.version != SNAPSHOT_VERSION) {
+                throw std::runtime_error("invalid snapshot: unsupported version " + std::to_string(header.version));
+            }
+            SnapshotHeader expected = header;
+            snapshot_layout(expected);
+            if (std::memcmp(&expected, &header, sizeof(header)) != 0 || header.file_size != data.size() ||
+                header.count > data.size() || header.names > data.size() || header.string_bytes > data.size() ||
+                header.kinds > KillRules::MAX_KINDS || header.kind_bytes > data.size()) {
+                throw std::runtime_error("invalid snapshot: inconsistent layout");
+            }
+            const uint8_t* kinds = reinterpret_cast<const uint8_t*>(data.data() + header.kinds_offset);
+            const double* xs = reinterpret_cast<const double*>(data.data() + header.x_offset);
+            const double* ys = reinterpret_cast<const double*>(data.data() + header.y_offset);
+            const uint32_t* name_ids = reinterpret_cast<const uint32_t*>(data.data() + header.name_ids_offset);
+            const uint64_t* offsets = reinterpret_cast<const uint64_t*>(data.data() + header.offsets_offset);
+            const char* chars = data.data() + header.chars_offset;
+            for (uint64_t k = 0; k < header.names; ++k) {
+                if (offsets[k] > offsets[k + 1] || offsets[k + 1] > header.string_bytes) {
+                    throw std::runtime_error("invalid snapshot: bad string table");
+                }
+            }
+            const uint64_t* kind_offsets = reinterpret_cast<const uint64_t*>(data.data() + header.kind_offsets_offset);
+            const char* kind_chars = data.data() + header.kind_chars_offset;
+            size_t kind_ids[KillRules::MAX_KINDS];
+            for (uint64_t k = 0; k < header.kinds; ++k) {
+                if (kind_offsets[k] > kind_offsets[k + 1] || kind_offsets[k + 1] > header.kind_bytes) {
+                    throw std::runtime_error("invalid snapshot: bad kind table");
+                }
+                std::string_view name(kind_chars + kind_offsets[k], kind_offsets[k + 1] - kind_offsets[k]);
+                kind_ids[k] = active_rules().find(name);
+            }
+            for (uint64_t i = 0; i < header.count; ++i) {
+                if (name_ids[i] >= header.names || kinds[i] >= header.kinds) {
+                    throw std::runtime_error("invalid snapshot: bad record " + std::to_string(i));
+                }
+                if (kind_ids[kinds[i]] == KillRules::NO_KIND) {
+                    std::string_view name(kind_chars + kind_offsets[kinds[i]],
+                                          kind_offsets[kinds[i] + 1] - kind_offsets[kinds[i]]);
+                    throw std::runtime_error("invalid snapshot: unknown kind " + std::string(name));
+                }
+            }
+            if constexpr (STATS_ENABLED) {
+                load_stats.bytes = data.size();
+                load_stats.records = header.count;
+                load_stats.loaded = header.count;
+            }
+            PhaseTimer build_timer(load_stats.build_ns);
+            std::vector<uint32_t> ids(header.names);
+            for (uint64_t k = 0; k < header.names; ++k) {
+                ids[k] = arr.get_names().intern(std::string_view(chars + offsets[k], offsets[k + 1] - offsets[k]));
+            }
+            arr.reserve(arr.get_size() + header.count);
+            for (uint64_t i = 0; i < header.count; ++i) {
+                arr.emplace_npc(static_cast<NPCKind>(kind_ids[kinds[i]]), ids[name_ids[i]], xs[i], ys[i]);
+            }
+        }
+        // Writes "type name x y" lines, byte for byte what
+        // fprintf("%s %s %lf %lf\n") produces, through a TextWriter.
+        static void save_to_file(const char* filename, const NPC_array& arr) {
+            TextWriter out(filename);
+            for (const auto& npc : arr.get_npcs()) {
+                write_record(out, *npc);
+            }
+            out.close();
+        }
+        // One line of save_to_file.
+        static void write_record(TextWriter& out, const NPC& npc) {
+            NPCKind kind = npc.get_kind();
+            if (kind == NPCKind::npc) {
+                out.append(npc.get_type());
+            }
+            else {
+                out.append(kind_name(kind));
+            }
+            out.put(' ');
+            out.append(npc.get_name());
+            out.put(' ');
+            out.append_fixed(npc.get_x_cord());
+            out.put(' ');
+            out.append_fixed(npc.get_y_cord());
+            out.put('\n');
         }
 };
 
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only intern table: every distinct name is stored once and gets a
+// dense id. The bytes live in fixed blocks that never move, so views
+// returned by get() stay valid until clear() or destruction.
+//
+// Nothing but clear() reclaims an entry: ids must stay stable for as long
+// as a snapshot or a victim list may hold them. An owner that removes or
+// kills NPCs therefore grows by every name it has ever seen; to drop the
+// dead names, clear it or copy the survivors into a fresh table (as
+// StreamingCombat::rebuild_names does with a fresh NPC_array).
+class NameTable {
+    public:
+        static constexpr uint32_t NO_NAME = UINT32_MAX;
+        static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+        NameTable() = default;
+        NameTable(const NameTable&) = delete;
+        NameTable& operator=(const NameTable&) = delete;
+
+        uint32_t intern(std::string_view name) {
+            size_t hash = std::hash<std::string_view>{}(name);
+            if ((entries.size() + 1) * 2 > slots.size()) {
+                grow();
+            }
+            size_t mask = slots.size() - 1;
+            for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                uint32_t id = slots[i];
+                if (id == NO_NAME) {
+                    id = static_cast<uint32_t>(entries.size());
+                    entries.push_back(store(name));
+                    hashes.push_back(hash);
+                    slots[i] = id;
+                    return id;
+                }
+                if (hashes[id] == hash && entries[id] == name) {
+                    return id;
+                }
+            }
+        }
+        // NO_NAME when the name was never interned.
+        uint32_t find(std::string_view name) const {
+            if (slots.empty()) {
+                return NO_NAME;
+            }
+            size_t hash = std::hash<std::string_view>{}(name);
+            size_t mask = slots.size() - 1;
+            for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                uint32_t id = slots[i];
+                if (id == NO_NAME || (hashes[id] == hash && entries[id] == name)) {
+                    return id;
+                }
+            }
+        }
+        std::string_view get(uint32_t id) const { return entries[id]; }
+        size_t size() const { return entries.size(); }
+        void clear() {
+            entries.clear();
+            hashes.clear();
+            slots.clear();
+            blocks.clear();
+            large.clear();
+            block_used = BLOCK_SIZE;
+        }
+
+    private:
+        std::string_view store(std::string_view name) {
+            if (name.empty()) {
+                return std::string_view();
+            }
+            if (name.size() > BLOCK_SIZE / 4) {
+                // long names get an allocation of their own
+                large.push_back(std::make_unique<char[]>(name.size()));
+                std::memcpy(large.back().get(), name.data(), name.size());
+                return std::string_view(large.back().get(), name.size());
+            }
+            if (BLOCK_SIZE - block_used < name.size()) {
+                blocks.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+                block_used = 0;
+            }
+            char* dst = blocks.back().get() + block_used;
+            std::memcpy(dst, name.data(), name.size());
+            block_used += name.size();
+            return std::string_view(dst, name.size());
+        }
+        void grow() {
+            size_t capacity = slots.empty() ? 64 : slots.size() * 2;
+            slots.assign(capacity, NO_NAME);
+            size_t mask = capacity - 1;
+            for (uint32_t id = 0; id < entries.size(); ++id) {
+                size_t i = hashes[id] & mask;
+                while (slots[i] != NO_NAME) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = id;
+            }
+        }
+
+        std::vector<std::string_view> entries;
+        std::vector<size_t> hashes;
+        std::vector<uint32_t> slots;
+        std::vector<std::unique_ptr<char[]>> blocks;
+        std::vector<std::unique_ptr<char[]>> large;
+        size_t block_used = BLOCK_SIZE;
+};
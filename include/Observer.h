@@ -9,11 +9,101 @@
 #include <cstdio>
 #include <vector>
 #include <cmath>
+#include <string_view>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "NPC.h"
+#include "Stats.h"
 
 
+// One kill. Names point into the name table of the NPC_array and stay
+// valid until the array is cleared or destroyed.
+struct CombatEvent {
+    std::string_view attacker_name;
+    std::string_view victim_name;
+    NPCKind attacker_kind;
+    NPCKind victim_kind;
+    double attacker_x, attacker_y;
+    double victim_x, victim_y;
+    size_t round;
+};
+
+// Appends the log.txt line for the event, without the trailing newline.
+inline void append_event(std::string& out, const CombatEvent& event) {
+    out += "NPC ";
+    out += kind_name(event.victim_kind);
+    out += ' ';
+    out += event.victim_name;
+    out += " убит. Убийца: ";
+    out += kind_name(event.attacker_kind);
+    out += ' ';
+    out += event.attacker_name;
+    out += '.';
+}
+
+inline std::string format_event(const CombatEvent& event) {
+    std::string out;
+    append_event(out, event);
+    return out;
+}
+
+// Events of one round, as the event bus hands them to observers. The
+// batch owns copies of the names, so it outlives the NPC_array. A batch
+// carries either plain messages or combat events, never both.
+class EventBatch {
+    public:
+        size_t round = 0;
+        std::vector<CombatEvent> events;
+        std::vector<std::string> messages;
+        bool has_stats = false;
+        CombatStats stats;
+
+        void add(const CombatEvent& event) {
+            events.push_back(event);
+            name_offsets.push_back(names.size());
+            names += event.attacker_name;
+            names += event.victim_name;
+        }
+        bool empty() const { return events.empty() && messages.empty() && !has_stats; }
+        // Points the events at the copied names; call once all are added.
+        void seal() {
+            std::string_view all = names;
+            for (size_t i = 0; i < events.size(); ++i) {
+                size_t offset = name_offsets[i];
+                size_t attacker = events[i].attacker_name.size();
+                events[i].attacker_name = all.substr(offset, attacker);
+                events[i].victim_name = all.substr(offset + attacker, events[i].victim_name.size());
+            }
+        }
+
+    private:
+        std::string names;
+        std::vector<size_t> name_offsets;
+};
+
 class Observer {
     public:
         virtual void update(const std::string& event) = 0;
+        // Text observers get the formatted line by default; observers that
+        // do not need text override this and never pay for formatting.
+        virtual void update(const CombatEvent& event) { update(format_event(event)); }
+        // The event bus delivers a round at a time, on the observer's own
+        // thread. Observers that can write a batch at once override this.
+        virtual void update_batch(const EventBatch& batch) {
+            for (const auto& message : batch.messages) {
+                update(message);
+            }
+            for (const auto& event : batch.events) {
+                update(event);
+            }
+        }
+        // End of a combat round; only called when stats are compiled in.
+        virtual void round_done(const CombatStats& stats) {}
+        // Loggers report what they have written so far.
+        virtual LoggerStats get_logger_stats() const { return {}; }
         virtual ~Observer() = default;
 };
 
@@ -22,15 +112,187 @@ class FileLogger: public Observer {
         FileLogger() : filename("log.txt") {}
         FileLogger(const std::string& name) : filename(name) {}
         void update(const std::string& event) override {
+            PhaseTimer timer(stats.write_ns);
             FILE* log = fopen(filename.c_str(), "a");  
             if (log) {
-                fprintf(log, "%s\n", event.c_str());
+                int written = fprintf(log, "%s\n", event.c_str());
                 fclose(log);
+                count(written);
             }
         }
+        void update(const CombatEvent& event) override {
+            PhaseTimer timer(stats.write_ns);
+            FILE* log = fopen(filename.c_str(), "a");
+            if (log) {
+                std::string_view victim_type = kind_name(event.victim_kind);
+                std::string_view attacker_type = kind_name(event.attacker_kind);
+                int written = fprintf(log, "NPC %.*s %.*s убит. Убийца: %.*s %.*s.\n",
+                        static_cast<int>(victim_type.size()), victim_type.data(),
+                        static_cast<int>(event.victim_name.size()), event.victim_name.data(),
+                        static_cast<int>(attacker_type.size()), attacker_type.data(),
+                        static_cast<int>(event.attacker_name.size()), event.attacker_name.data());
+                fclose(log);
+                count(written);
+            }
+        }
+        LoggerStats get_logger_stats() const override { return stats; }
         ~FileLogger() = default;
     private:
+        void count(int written) {
+            if constexpr (STATS_ENABLED) {
+                ++stats.events;
+                stats.bytes += written > 0 ? written : 0;
+            }
+        }
+
         std::string filename;
+        LoggerStats stats;
+};
+
+enum class OverflowPolicy { block, drop };
+
+// FileLogger that keeps the file open and writes from a background thread.
+// update() copies the event into a bounded ring of reusable slots; the
+// writer drains the ring in batches through a large stdio buffer and
+// flushes the file every flush_interval, on flush() and on destruction.
+// When the ring is full, update() either waits for space or drops the
+// event and counts it, depending on the policy.
+class AsyncFileLogger: public Observer {
+    public:
+        AsyncFileLogger(const std::string& name = "log.txt", size_t capacity = 65536,
+                        std::chrono::milliseconds interval = std::chrono::milliseconds(100),
+                        OverflowPolicy overflow = OverflowPolicy::block)
+            : filename(name), slots(capacity ? capacity : 1), flush_interval(interval),
+              policy(overflow), io_buffer(1 << 20) {
+            file = fopen(filename.c_str(), "a");
+            if (file) {
+                setvbuf(file, io_buffer.data(), _IOFBF, io_buffer.size());
+            }
+            writer = std::thread([this] { writer_loop(); });
+        }
+        AsyncFileLogger(const AsyncFileLogger&) = delete;
+        AsyncFileLogger& operator=(const AsyncFileLogger&) = delete;
+        ~AsyncFileLogger() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            not_empty.notify_one();
+            writer.join();
+            if (file) {
+                fclose(file);
+            }
+        }
+        void update(const std::string& event) override {
+            push([&](std::string& slot) { slot.assign(event); });
+        }
+        void update(const CombatEvent& event) override {
+            push([&](std::string& slot) {
+                slot.clear();
+                append_event(slot, event);
+            });
+        }
+        // Blocks until every event accepted so far is written and flushed.
+        void flush() {
+            std::unique_lock<std::mutex> lock(mutex);
+            uint64_t target = pushed;
+            flush_requested = true;
+            not_empty.notify_one();
+            flushed_cv.wait(lock, [&] { return flushed >= target; });
+        }
+        uint64_t get_dropped() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return dropped;
+        }
+        // Events and bytes accepted; write_ns is the writer thread's I/O.
+        LoggerStats get_logger_stats() const override {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stats;
+        }
+
+    private:
+        template <typename Fill>
+        void push(Fill&& fill) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (pushed - popped == slots.size()) {
+                if (policy == OverflowPolicy::drop) {
+                    ++dropped;
+                    return;
+                }
+                not_full.wait(lock, [this] { return pushed - popped < slots.size(); });
+            }
+            std::string& slot = slots[pushed % slots.size()];
+            fill(slot);
+            if constexpr (STATS_ENABLED) {
+                ++stats.events;
+                stats.bytes += slot.size() + 1;
+            }
+            ++pushed;
+            if (pushed - popped == 1) {
+                not_empty.notify_one();
+            }
+        }
+        void writer_loop() {
+            std::string batch;
+            std::unique_lock<std::mutex> lock(mutex);
+            auto next_flush = std::chrono::steady_clock::now() + flush_interval;
+            while (true) {
+                not_empty.wait_until(lock, next_flush, [this] {
+                    return stopping || flush_requested || pushed != popped;
+                });
+                batch.clear();
+                for (; popped != pushed; ++popped) {
+                    batch += slots[popped % slots.size()];
+                    batch += '\n';
+                }
+                uint64_t written = popped;
+                bool done = stopping;
+                bool flush_now = flush_requested || done ||
+                                 std::chrono::steady_clock::now() >= next_flush;
+                flush_requested = false;
+                not_full.notify_all();
+                lock.unlock();
+                uint64_t write_ns = 0;
+                {
+                    PhaseTimer timer(write_ns);
+                    if (file && !batch.empty()) {
+                        fwrite(batch.data(), 1, batch.size(), file);
+                    }
+                    if (file && flush_now) {
+                        fflush(file);
+                    }
+                }
+                lock.lock();
+                stats.write_ns += write_ns;
+                if (flush_now) {
+                    flushed = written;
+                    flushed_cv.notify_all();
+                    next_flush = std::chrono::steady_clock::now() + flush_interval;
+                }
+                if (done && popped == pushed) {
+                    return;
+                }
+            }
+        }
+
+        std::string filename;
+        std::vector<std::string> slots;
+        std::chrono::milliseconds flush_interval;
+        OverflowPolicy policy;
+        std::vector<char> io_buffer;
+        FILE* file = nullptr;
+        mutable std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::condition_variable flushed_cv;
+        uint64_t pushed = 0;
+        uint64_t popped = 0;
+        uint64_t flushed = 0;
+        uint64_t dropped = 0;
+        LoggerStats stats;
+        bool flush_requested = false;
+        bool stopping = false;
+        std::thread writer;
 };
 
 class Display: public Observer {
@@ -38,4 +300,27 @@ public:
     void update(const std::string& event) override {
         std::cout << event << std::endl;
     }
-};
\ No newline at end of file
+    void update(const CombatEvent& event) override {
+        std::cout << "NPC " << kind_name(event.victim_kind) << ' ' << event.victim_name
+                  << " убит. Убийца: " << kind_name(event.attacker_kind) << ' '
+                  << event.attacker_name << '.' << std::endl;
+    }
+};
+// Prints the stats of every combat round; ignores the events themselves.
+// Needs a build with NPC_STATS=1, otherwise it never hears of a round.
+class StatsObserver: public Observer {
+    public:
+        explicit StatsObserver(FILE* output = stderr) : out(output) {}
+        void update(const std::string& event) override {}
+        void update(const CombatEvent& event) override {}
+        void round_done(const CombatStats& stats) override {
+            last = stats;
+            if (out) {
+                print_stats(out, stats);
+            }
+        }
+        const CombatStats& get_last() const { return last; }
+    private:
+        FILE* out;
+        CombatStats last;
+};
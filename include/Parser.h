@@ -0,0 +1,123 @@
+#pragma once
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+struct NPCRecord {
+    std::string_view type;
+    std::string_view name;
+    double x;
+    double y;
+};
+
+// In-place tokenizer for NPC text files. Accepts what
+// fscanf("%255s %255s %lf %lf") accepts: whitespace separated fields,
+// words of at most 255 bytes, and parsing stops at the end of input or at
+// the first field that is not a number.
+class NPCRecordParser {
+    public:
+        static constexpr size_t MAX_WORD = 255;
+
+        explicit NPCRecordParser(std::string_view text) : p(text.data()), end(text.data() + text.size()) {}
+        bool next(NPCRecord& rec) {
+            return read_word(rec.type) && read_word(rec.name) && read_number(rec.x) && read_number(rec.y);
+        }
+        const char* position() const { return p; }
+        // After next() failed: true when the input simply ran out, false
+        // when a field could not be parsed as a number.
+        bool at_end() const { return p == end; }
+
+        static bool is_space(char c) {
+            return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+        }
+        static bool is_blank(std::string_view text) {
+            for (char c : text) {
+                if (!is_space(c)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        void skip_space() {
+            while (p != end && is_space(*p)) {
+                ++p;
+            }
+        }
+        bool read_word(std::string_view& out) {
+            skip_space();
+            if (p == end) {
+                return false;
+            }
+            const char* begin = p;
+            while (p != end && !is_space(*p) && static_cast<size_t>(p - begin) < MAX_WORD) {
+                ++p;
+            }
+            out = std::string_view(begin, p - begin);
+            return true;
+        }
+        bool read_number(double& out) {
+            skip_space();
+            const char* begin = p;
+            if (begin != end && *begin == '+') {
+                // from_chars rejects a leading plus, strtod does not
+                ++begin;
+                if (begin != end && *begin == '-') {
+                    return false;
+                }
+            }
+            const char* digits = begin != end && *begin == '-' ? begin + 1 : begin;
+            if (end - digits > 1 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+                return read_hex(begin, out);
+            }
+            auto [ptr, ec] = std::from_chars(begin, end, out);
+            if (ec == std::errc::invalid_argument) {
+                return false;
+            }
+            if (ec == std::errc::result_out_of_range) {
+                // rare: let strtod produce the same +-HUGE_VAL / 0 that fscanf stores
+                out = std::strtod(std::string(begin, ptr).c_str(), nullptr);
+            }
+            p = skip_bare_exponent(ptr, 'e');
+            return true;
+        }
+        // fscanf has consumed an exponent marker and its sign by the time it
+        // finds no digits after them; it keeps the mantissa and goes on
+        // after them, so "1e+ 5" is 1 and 5.
+        const char* skip_bare_exponent(const char* ptr, char marker) const {
+            unsigned char last = static_cast<unsigned char>(ptr[-1]);
+            // not after inf or nan
+            bool after_mantissa = last == '.' || (marker == 'p' ? std::isxdigit(last) : std::isdigit(last));
+            if (ptr == end || !after_mantissa || (*ptr | 0x20) != marker) {
+                return ptr;
+            }
+            ++ptr;
+            if (ptr != end && (*ptr == '+' || *ptr == '-')) {
+                ++ptr;
+            }
+            return ptr;
+        }
+
+        // from_chars reads no 0x prefix; strtod takes hex floats like fscanf.
+        bool read_hex(const char* begin, double& out) {
+            const char* word = begin;
+            while (word != end && !is_space(*word)) {
+                ++word;
+            }
+            std::string text(begin, word);
+            char* stop;
+            out = std::strtod(text.c_str(), &stop);
+            if (stop == text.c_str()) {
+                return false;
+            }
+            p = skip_bare_exponent(begin + (stop - text.c_str()), 'p');
+            return true;
+        }
+
+        const char* p;
+        const char* end;
+};
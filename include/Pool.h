@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Allocator for objects of one fixed size. Memory is taken from the heap in
+// chunks of SLOTS_PER_CHUNK slots; released slots go to an intrusive free
+// list and are handed out again before a new chunk is touched. reset()
+// returns every chunk at once, so owners must have destroyed (or be done
+// with) all objects living in the pool.
+class SlotPool {
+    public:
+        static constexpr size_t SLOTS_PER_CHUNK = 4096;
+
+        explicit SlotPool(size_t object_size)
+            : slot_size(round_up(std::max(object_size, sizeof(FreeSlot)))) {}
+        SlotPool(const SlotPool&) = delete;
+        SlotPool& operator=(const SlotPool&) = delete;
+
+        void* allocate() {
+            if (free_list) {
+                FreeSlot* slot = free_list;
+                free_list = slot->next;
+                return slot;
+            }
+            if (used_in_chunk == SLOTS_PER_CHUNK) {
+                chunks.push_back(std::make_unique<std::byte[]>(slot_size * SLOTS_PER_CHUNK));
+                used_in_chunk = 0;
+            }
+            return chunks.back().get() + slot_size * used_in_chunk++;
+        }
+        void release(void* p) {
+            FreeSlot* slot = static_cast<FreeSlot*>(p);
+            slot->next = free_list;
+            free_list = slot;
+        }
+        void reset() {
+            chunks.clear();
+            free_list = nullptr;
+            used_in_chunk = SLOTS_PER_CHUNK;
+        }
+        size_t get_chunk_count() const { return chunks.size(); }
+        size_t get_slot_size() const { return slot_size; }
+
+    private:
+        struct FreeSlot {
+            FreeSlot* next;
+        };
+        static size_t round_up(size_t size) {
+            constexpr size_t align = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+            return (size + align - 1) / align * align;
+        }
+
+        size_t slot_size;
+        std::vector<std::unique_ptr<std::byte[]>> chunks;
+        size_t used_in_chunk = SLOTS_PER_CHUNK;
+        FreeSlot* free_list = nullptr;
+};
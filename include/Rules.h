@@ -0,0 +1,173 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "Names.h"
+
+// Built-in kinds in NPCKind order; config files add kinds after them.
+constexpr std::string_view BUILTIN_KINDS[] = {"NPC", "squirrel", "werewolf", "druid"};
+constexpr size_t NPC_KIND_COUNT = std::size(BUILTIN_KINDS);
+
+// KILL_MATRIX[attacker][target] is true when the attacker kills the target.
+// This is the default config; VariantCombat relies on it at compile time.
+constexpr bool KILL_MATRIX[NPC_KIND_COUNT][NPC_KIND_COUNT] = {
+    //            npc    squirrel werewolf druid
+    /* npc      */ {false, false,   false,   false},
+    /* squirrel */ {false, false,   true,    true },
+    /* werewolf */ {false, false,   false,   true },
+    /* druid    */ {false, false,   false,   false},
+};
+
+// NPC kinds and who kills whom. Kind ids are dense and fit a uint8_t: the
+// built-in kinds come first, config kinds follow in declaration order.
+// The rules are a bit matrix with one MAX_KINDS-bit row per attacker, so
+// checking a pair is a single load whatever the number of kinds.
+//
+// Config files have one statement per line; # starts a comment:
+//     kind dragon
+//     dragon kills squirrel werewolf druid
+// A config replaces the default rules, it does not add to them.
+class KillRules {
+    public:
+        static constexpr size_t MAX_KINDS = 256;
+        static constexpr size_t NO_KIND = SIZE_MAX;
+
+        // The default config: built-in kinds and KILL_MATRIX.
+        KillRules() : KillRules(0) {
+            for (size_t a = 0; a < NPC_KIND_COUNT; ++a) {
+                for (size_t t = 0; t < NPC_KIND_COUNT; ++t) {
+                    set_kill(a, t, KILL_MATRIX[a][t]);
+                }
+            }
+        }
+        KillRules(const KillRules& other) : names(), bits(other.bits), id(other.id) {
+            for (uint32_t k = 0; k < other.names.size(); ++k) {
+                names.intern(other.names.get(k));
+            }
+        }
+        KillRules& operator=(const KillRules& other) {
+            if (this != &other) {
+                names.clear();
+                for (uint32_t k = 0; k < other.names.size(); ++k) {
+                    names.intern(other.names.get(k));
+                }
+                bits = other.bits;
+                id = other.id;
+            }
+            return *this;
+        }
+
+        // Built-in kinds that kill nothing; where a config starts from.
+        static KillRules builtin_kinds() { return KillRules(0); }
+        static KillRules parse(std::string_view text) {
+            KillRules rules = builtin_kinds();
+            std::istringstream in{std::string(text)};
+            std::string line;
+            for (int line_number = 1; std::getline(in, line); ++line_number) {
+                line = line.substr(0, line.find('#'));
+                std::istringstream words(line);
+                std::string first, verb, target;
+                if (!(words >> first)) {
+                    continue;
+                }
+                if (!(words >> verb)) {
+                    throw std::runtime_error("Line " + std::to_string(line_number) + ": incomplete rule");
+                }
+                if (first == "kind") {
+                    rules.add_kind(verb);
+                    if (words >> target) {
+                        throw std::runtime_error("Line " + std::to_string(line_number) + ": one kind per line");
+                    }
+                    continue;
+                }
+                if (verb != "kills") {
+                    throw std::runtime_error("Line " + std::to_string(line_number) + ": expected 'kills'");
+                }
+                size_t attacker = rules.known(first, line_number);
+                while (words >> target) {
+                    rules.set_kill(attacker, rules.known(target, line_number));
+                }
+            }
+            return rules;
+        }
+        static KillRules load(const char* filename) {
+            std::ifstream in(filename);
+            if (!in) {
+                throw std::runtime_error("can't open file");
+            }
+            std::stringstream text;
+            text << in.rdbuf();
+            return parse(text.str());
+        }
+
+        size_t add_kind(std::string_view name) {
+            size_t kind = find(name);
+            if (kind != NO_KIND) {
+                return kind;
+            }
+            if (names.size() == MAX_KINDS) {
+                throw std::runtime_error("too many NPC kinds");
+            }
+            changed();
+            return names.intern(name);
+        }
+        size_t find(std::string_view name) const {
+            uint32_t kind = names.find(name);
+            return kind == NameTable::NO_NAME ? NO_KIND : kind;
+        }
+        std::string_view name(size_t kind) const { return names.get(static_cast<uint32_t>(kind)); }
+        size_t size() const { return names.size(); }
+        void set_kill(size_t attacker, size_t target, bool kill = true) {
+            if (attacker >= size() || target >= size()) {
+                throw std::logic_error("kill rule for an unknown kind");
+            }
+            uint64_t bit = uint64_t(1) << (target % 64);
+            uint64_t& word = bits[attacker * WORDS + target / 64];
+            word = kill ? word | bit : word & ~bit;
+            changed();
+        }
+        bool kills(size_t attacker, size_t target) const {
+            return (bits[attacker * WORDS + target / 64] >> (target % 64)) & 1;
+        }
+        // Changes with every edit, so a round can tell whether the rules it
+        // was settled under still hold.
+        uint64_t get_id() const { return id; }
+
+    private:
+        static constexpr size_t WORDS = MAX_KINDS / 64;
+
+        explicit KillRules(int) {
+            for (std::string_view kind : BUILTIN_KINDS) {
+                names.intern(kind);
+            }
+            changed();
+        }
+        size_t known(const std::string& name, int line_number) const {
+            size_t kind = find(name);
+            if (kind == NO_KIND) {
+                throw std::runtime_error("Line " + std::to_string(line_number) + ": unknown kind " + name);
+            }
+            return kind;
+        }
+        void changed() {
+            static std::atomic<uint64_t> next_id{1};
+            id = next_id++;
+        }
+
+        NameTable names;
+        std::array<uint64_t, MAX_KINDS * WORDS> bits{};
+        uint64_t id = 0;
+};
+
+// The rules combat, the loaders and the loggers use. Replace them at
+// startup, before any NPC of a config kind exists.
+inline KillRules& active_rules() {
+    static KillRules rules;
+    return rules;
+}
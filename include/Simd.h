@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define NPC_SIMD_X86 1
+#endif
+
+// Range kernels: test one attacker at (ax, ay) against up to RANGE_BLOCK
+// targets stored contiguously in xs/ys. Bit k of the result is set when
+// target k is within sqrt(rad2). All variants compute dx*dx + dy*dy with
+// separate multiplies and adds, so they agree bit for bit with each other.
+constexpr size_t RANGE_BLOCK = 8;
+
+using RangeKernel = uint32_t (*)(double ax, double ay, const double* xs, const double* ys,
+                                 size_t count, double rad2);
+
+inline uint32_t range_mask_scalar(double ax, double ay, const double* xs, const double* ys,
+                                  size_t count, double rad2) {
+    uint32_t mask = 0;
+    for (size_t k = 0; k < count; ++k) {
+        double dx = ax - xs[k];
+        double dy = ay - ys[k];
+        mask |= uint32_t(dx * dx + dy * dy <= rad2) << k;
+    }
+    return mask;
+}
+
+#ifdef NPC_SIMD_X86
+inline uint32_t range_mask_sse2(double ax, double ay, const double* xs, const double* ys,
+                                size_t count, double rad2) {
+    if (count < RANGE_BLOCK) {
+        return range_mask_scalar(ax, ay, xs, ys, count, rad2);
+    }
+    __m128d vx = _mm_set1_pd(ax);
+    __m128d vy = _mm_set1_pd(ay);
+    __m128d vr = _mm_set1_pd(rad2);
+    uint32_t mask = 0;
+    for (size_t k = 0; k < RANGE_BLOCK; k += 2) {
+        __m128d dx = _mm_sub_pd(vx, _mm_loadu_pd(xs + k));
+        __m128d dy = _mm_sub_pd(vy, _mm_loadu_pd(ys + k));
+        __m128d d2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        mask |= uint32_t(_mm_movemask_pd(_mm_cmple_pd(d2, vr))) << k;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+inline uint32_t range_mask_avx2(double ax, double ay, const double* xs, const double* ys,
+                                size_t count, double rad2) {
+    if (count < RANGE_BLOCK) {
+        return range_mask_scalar(ax, ay, xs, ys, count, rad2);
+    }
+    __m256d vx = _mm256_set1_pd(ax);
+    __m256d vy = _mm256_set1_pd(ay);
+    __m256d vr = _mm256_set1_pd(rad2);
+    uint32_t mask = 0;
+    for (size_t k = 0; k < RANGE_BLOCK; k += 4) {
+        __m256d dx = _mm256_sub_pd(vx, _mm256_loadu_pd(xs + k));
+        __m256d dy = _mm256_sub_pd(vy, _mm256_loadu_pd(ys + k));
+        __m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+        mask |= uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(d2, vr, _CMP_LE_OQ))) << k;
+    }
+    return mask;
+}
+#endif
+
+// Picks the widest kernel the running CPU supports.
+inline RangeKernel select_range_kernel() {
+#ifdef NPC_SIMD_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return range_mask_avx2;
+    }
+    return range_mask_sse2;
+#else
+    return range_mask_scalar;
+#endif
+}
+
+// Move kernels: advance count positions by their heading times step and
+// keep them inside [0, limit]. A coordinate that hits a wall stays on it
+// and its heading component flips. Clamping is written as the max/min
+// instruction semantics (NaN lands on 0), and all variants agree bit for
+// bit.
+using MoveKernel = void (*)(double* xs, double* ys, double* vxs, double* vys, const double* steps,
+                            size_t count, double limit);
+
+inline void move_scalar(double* xs, double* ys, double* vxs, double* vys, const double* steps,
+                        size_t count, double limit) {
+    for (size_t k = 0; k < count; ++k) {
+        double nx = xs[k] + vxs[k] * steps[k];
+        double ny = ys[k] + vys[k] * steps[k];
+        double cx = nx > 0.0 ? nx : 0.0;
+        double cy = ny > 0.0 ? ny : 0.0;
+        cx = cx < limit ? cx : limit;
+        cy = cy < limit ? cy : limit;
+        vxs[k] = nx != cx ? -vxs[k] : vxs[k];
+        vys[k] = ny != cy ? -vys[k] : vys[k];
+        xs[k] = cx;
+        ys[k] = cy;
+    }
+}
+
+#ifdef NPC_SIMD_X86
+__attribute__((target("avx2")))
+inline void move_avx2(double* xs, double* ys, double* vxs, double* vys, const double* steps,
+                      size_t count, double limit) {
+    __m256d zero = _mm256_setzero_pd();
+    __m256d top = _mm256_set1_pd(limit);
+    __m256d sign = _mm256_set1_pd(-0.0);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m256d step = _mm256_loadu_pd(steps + k);
+        __m256d vx = _mm256_loadu_pd(vxs + k);
+        __m256d vy = _mm256_loadu_pd(vys + k);
+        __m256d nx = _mm256_add_pd(_mm256_loadu_pd(xs + k), _mm256_mul_pd(vx, step));
+        __m256d ny = _mm256_add_pd(_mm256_loadu_pd(ys + k), _mm256_mul_pd(vy, step));
+        __m256d cx = _mm256_min_pd(_mm256_max_pd(nx, zero), top);
+        __m256d cy = _mm256_min_pd(_mm256_max_pd(ny, zero), top);
+        vx = _mm256_xor_pd(vx, _mm256_and_pd(_mm256_cmp_pd(nx, cx, _CMP_NEQ_UQ), sign));
+        vy = _mm256_xor_pd(vy, _mm256_and_pd(_mm256_cmp_pd(ny, cy, _CMP_NEQ_UQ), sign));
+        _mm256_storeu_pd(vxs + k, vx);
+        _mm256_storeu_pd(vys + k, vy);
+        _mm256_storeu_pd(xs + k, cx);
+        _mm256_storeu_pd(ys + k, cy);
+    }
+    move_scalar(xs + k, ys + k, vxs + k, vys + k, steps + k, count - k, limit);
+}
+#endif
+
+inline MoveKernel select_move_kernel() {
+#ifdef NPC_SIMD_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return move_avx2;
+    }
+#endif
+    return move_scalar;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Binary NPC snapshot, native byte order. After the header come the
+// sections below, each starting at the recorded offset (8-byte aligned):
+//   kinds    uint8_t  [count]        NPCKind of each NPC
+//   x, y     double   [count] each   coordinates, bit exact
+//   name_ids uint32_t [count]        index into the string table
+//   offsets  uint64_t [names + 1]    byte ranges of the names in chars
+//   chars    char     [string_bytes] names, not terminated
+//   kind_offsets uint64_t [kinds + 1]      byte ranges in kind_chars
+//   kind_chars   char     [kind_bytes]     name of each kind id in kinds
+// Kind ids depend on the rules config, so a loader maps them by name.
+constexpr char SNAPSHOT_MAGIC[8] = {'N', 'P', 'C', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t count;
+    uint64_t names;
+    uint64_t string_bytes;
+    uint64_t kinds;
+    uint64_t kind_bytes;
+    uint64_t kinds_offset;
+    uint64_t x_offset;
+    uint64_t y_offset;
+    uint64_t name_ids_offset;
+    uint64_t offsets_offset;
+    uint64_t chars_offset;
+    uint64_t kind_offsets_offset;
+    uint64_t kind_chars_offset;
+    uint64_t file_size;
+};
+
+inline uint64_t snapshot_align(uint64_t offset) {
+    return (offset + 7) & ~uint64_t(7);
+}
+
+// Fills in the section offsets of a header whose counts are set.
+inline void snapshot_layout(SnapshotHeader& h) {
+    std::memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.header_size = sizeof(SnapshotHeader);
+    h.kinds_offset = sizeof(SnapshotHeader);
+    h.x_offset = snapshot_align(h.kinds_offset + h.count);
+    h.y_offset = h.x_offset + h.count * sizeof(double);
+    h.name_ids_offset = h.y_offset + h.count * sizeof(double);
+    h.offsets_offset = snapshot_align(h.name_ids_offset + h.count * sizeof(uint32_t));
+    h.chars_offset = h.offsets_offset + (h.names + 1) * sizeof(uint64_t);
+    h.kind_offsets_offset = snapshot_align(h.chars_offset + h.string_bytes);
+    h.kind_chars_offset = h.kind_offsets_offset + (h.kinds + 1) * sizeof(uint64_t);
+    h.file_size = h.kind_chars_offset + h.kind_bytes;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Per-phase timings and counters of combat rounds, loaders and loggers.
+// Build with -DNPC_STATS=1 to collect them. Otherwise PhaseTimer is an
+// empty object, every counter update sits behind `if constexpr
+// (STATS_ENABLED)`, and the stats structs simply stay zero.
+#ifndef NPC_STATS
+#define NPC_STATS 0
+#endif
+
+constexpr bool STATS_ENABLED = NPC_STATS != 0;
+
+// Optional process-wide allocation count, e.g. from a counting operator
+// new in the executable; the library does not replace operator new.
+inline uint64_t (*stats_allocation_counter)() = nullptr;
+
+inline uint64_t stats_allocations() {
+    return stats_allocation_counter ? stats_allocation_counter() : 0;
+}
+
+template <bool Enabled>
+class BasicPhaseTimer {
+    public:
+        explicit BasicPhaseTimer(uint64_t&) {}
+};
+
+// Adds its own lifetime, in nanoseconds, to target.
+template <>
+class BasicPhaseTimer<true> {
+    public:
+        explicit BasicPhaseTimer(uint64_t& target) : target(target), start(std::chrono::steady_clock::now()) {}
+        BasicPhaseTimer(const BasicPhaseTimer&) = delete;
+        BasicPhaseTimer& operator=(const BasicPhaseTimer&) = delete;
+        ~BasicPhaseTimer() {
+            target += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+
+    private:
+        uint64_t& target;
+        std::chrono::steady_clock::time_point start;
+};
+
+using PhaseTimer = BasicPhaseTimer<STATS_ENABLED>;
+
+// One combat round. fight_ns is the visitor calls without notify_ns,
+// which covers building events and running the observers (formatting and
+// logger I/O). bytes_logged comes from synchronous observers that report
+// LoggerStats; behind an event bus they log later, on their own threads.
+struct CombatStats {
+    uint64_t round = 0;
+    uint64_t npcs = 0;
+    uint64_t movement_ns = 0;
+    uint64_t columns_ns = 0;
+    uint64_t grid_ns = 0;
+    uint64_t scan_ns = 0;
+    uint64_t fight_ns = 0;
+    uint64_t notify_ns = 0;
+    uint64_t cleanup_ns = 0;
+    uint64_t total_ns = 0;
+    uint64_t pairs_tested = 0;
+    uint64_t pairs_in_range = 0;
+    uint64_t kills = 0;
+    uint64_t events = 0;
+    uint64_t bytes_logged = 0;
+    uint64_t allocations = 0;
+};
+
+// One NPCFactory load. Loaders that parse and build in one pass only
+// fill total_ns.
+struct LoadStats {
+    uint64_t bytes = 0;
+    uint64_t records = 0;
+    uint64_t loaded = 0;
+    uint64_t rejected = 0;
+    uint64_t parse_ns = 0;
+    uint64_t build_ns = 0;
+    uint64_t total_ns = 0;
+};
+
+// Running totals of a logger.
+struct LoggerStats {
+    uint64_t events = 0;
+    uint64_t bytes = 0;
+    uint64_t write_ns = 0;
+};
+
+inline void print_stats(FILE* out, const CombatStats& s) {
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    fprintf(out,
+            "round %llu: npcs=%llu total=%.3fms movement=%.3fms columns=%.3fms grid=%.3fms scan=%.3fms "
+            "fight=%.3fms notify=%.3fms cleanup=%.3fms tested=%llu in_range=%llu kills=%llu events=%llu "
+            "bytes_logged=%llu allocs=%llu\n",
+            static_cast<unsigned long long>(s.round), static_cast<unsigned long long>(s.npcs),
+            ms(s.total_ns), ms(s.movement_ns), ms(s.columns_ns), ms(s.grid_ns), ms(s.scan_ns),
+            ms(s.fight_ns), ms(s.notify_ns), ms(s.cleanup_ns),
+            static_cast<unsigned long long>(s.pairs_tested), static_cast<unsigned long long>(s.pairs_in_range),
+            static_cast<unsigned long long>(s.kills), static_cast<unsigned long long>(s.events),
+            static_cast<unsigned long long>(s.bytes_logged), static_cast<unsigned long long>(s.allocations));
+}
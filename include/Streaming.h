@@ -0,0 +1,206 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include "NPC.h"
+#include "TextWriter.h"
+#include "Visitor.h"
+
+// Tile coordinates of a position. A tile-sorted world file lists its
+// records by (tile_row(y), tile_col(x)), as `npcgen --tile` writes them.
+inline int64_t tile_row(double y, double tile) { return static_cast<int64_t>(std::floor(y / tile)); }
+inline int64_t tile_col(double x, double tile) { return static_cast<int64_t>(std::floor(x / tile)); }
+
+struct StreamStats {
+    uint64_t loaded = 0;
+    uint64_t written = 0;
+    uint64_t rows = 0;
+    uint64_t peak_resident = 0;  // most NPCs held at once
+};
+
+// One combat round over a tile-sorted world file, without loading the
+// world. Rows of tiles are read in file order; the NPCs of row a attack
+// once rows a - 1 .. a + 1 are resident, and with tile >= rad (and every
+// kind radius) nothing further away is in range. Row a - 1 can then no
+// longer be hit and its survivors go straight to the output. At most
+// three rows are resident (plus the interned names, which are rebuilt
+// once they outgrow them).
+// Attackers act in file order against the same neighbours and liveness
+// as in memory, so kills, events and the output file equal
+// load_from_file_c_style + do_combat + save_to_file on the same file.
+class StreamingCombat {
+    public:
+        StreamingCombat(CombatVisitor& visitor, double tile) : visitor(visitor), tile(tile) {
+            if (!(tile > 0)) {
+                throw std::logic_error("tile size must be positive");
+            }
+        }
+
+        StreamStats run(const char* input, const char* output, double rad) {
+            if (visitor.reach(rad) > tile) {
+                throw std::logic_error("attack radius must not exceed the tile size");
+            }
+            FILE* file = fopen(input, "r");
+            if (!file) {
+                throw std::runtime_error("can't open file");
+            }
+            try {
+                TextWriter out(output);
+                stream(file, out, rad);
+                out.close();
+            } catch (...) {
+                fclose(file);
+                throw;
+            }
+            fclose(file);
+            return stats;
+        }
+
+    private:
+        struct Row {
+            int64_t id;
+            size_t count;
+        };
+
+        void stream(FILE* file, TextWriter& out, double rad) {
+            stats = StreamStats{};
+            window.clear();
+            rows.clear();
+            line_number = 0;
+            pending = read_record(file);
+            visitor.start_round();
+            size_t attacked = 0;  // rows[0 .. attacked) have attacked
+            while (true) {
+                if (attacked == rows.size() && !pending) {
+                    break;
+                }
+                if (attacked == rows.size()) {
+                    load_row(file);
+                }
+                int64_t a = rows[attacked].id;
+                while (pending && pending_row == a + 1) {
+                    load_row(file);
+                }
+                stats.peak_resident = std::max<uint64_t>(stats.peak_resident, window.get_size());
+                size_t first = 0;
+                for (size_t k = 0; k < attacked; ++k) {
+                    first += rows[k].count;
+                }
+                visitor.attack_range(window, first, first + rows[attacked].count, rad);
+                visitor.publish_events();
+                erase_dead();
+                ++attacked;
+                size_t done = 0;
+                while (done < attacked && rows[done].id < a) {
+                    ++done;
+                }
+                flush(out, done);
+                attacked -= done;
+            }
+            flush(out, rows.size());
+        }
+
+        // Appends every record of the next row to the window.
+        void load_row(FILE* file) {
+            int64_t id = pending_row;
+            if (!rows.empty() && id <= rows.back().id) {
+                throw std::runtime_error("Line " + std::to_string(line_number) + ": world file is not sorted into tiles");
+            }
+            size_t count = 0;
+            while (pending && pending_row == id) {
+                window.emplace_npc(kind, name, x, y);
+                ++count;
+                pending = read_record(file);
+            }
+            rows.push_back({id, count});
+            stats.loaded += count;
+            ++stats.rows;
+        }
+
+        // Next valid record, with the diagnostics of load_from_file_c_style.
+        bool read_record(FILE* file) {
+            char type[MAX_LENGTH];
+            while (fscanf(file, "%255s %255s %lf %lf", type, name, &x, &y) == 4) {
+                line_number++;
+                if (x < 0 || x > WORLD_SIZE || y < 0 || y > WORLD_SIZE) {
+                    fprintf(stderr, "Line %d: invalid NPC coords (%.2f, %.2f)\n",
+                            line_number, x, y);
+                    continue;
+                }
+                try {
+                    kind = NPCFactory::kind_of(type);
+                } catch (const std::exception& e) {
+                    fprintf(stderr, "Line %d: error creating NPC: %s\n",
+                            line_number, e.what());
+                    continue;
+                }
+                pending_row = tile_row(y, tile);
+                return true;
+            }
+            return false;
+        }
+
+        // The dead can neither attack nor be hit again.
+        void erase_dead() {
+            auto& npcs = window.get_npcs();
+            size_t i = 0;
+            for (Row& row : rows) {
+                size_t alive = 0;
+                for (size_t end = i + row.count; i < end; ++i) {
+                    alive += npcs[i]->is_alive_NPC();
+                }
+                row.count = alive;
+            }
+            window.erase_dead();
+        }
+
+        // Writes and drops the first count rows.
+        void flush(TextWriter& out, size_t count) {
+            size_t npcs = 0;
+            for (size_t k = 0; k < count; ++k) {
+                npcs += rows[k].count;
+            }
+            if (count == 0) {
+                return;
+            }
+            auto& all = window.get_npcs();
+            for (size_t i = 0; i < npcs; ++i) {
+                NPCFactory::write_record(out, *all[i]);
+            }
+            stats.written += npcs;
+            window.erase_front(npcs);
+            rows.erase(rows.begin(), rows.begin() + count);
+            if (window.get_names().size() > 2 * window.get_size() + 4096) {
+                rebuild_names();
+            }
+        }
+
+        // Names of retired NPCs stay interned; a fresh array drops them.
+        void rebuild_names() {
+            NPC_array fresh;
+            fresh.reserve(window.get_size());
+            for (const auto& npc : window.get_npcs()) {
+                fresh.emplace_npc(npc->get_kind(), npc->get_name(), npc->get_x_cord(), npc->get_y_cord());
+            }
+            window = std::move(fresh);
+        }
+
+        CombatVisitor& visitor;
+        double tile;
+        NPC_array window;
+        std::deque<Row> rows;
+        StreamStats stats;
+        int line_number = 0;
+        // next record, read ahead of its row
+        bool pending = false;
+        int64_t pending_row = 0;
+        NPCKind kind = NPCKind::npc;
+        char name[MAX_LENGTH];
+        double x = 0;
+        double y = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Buffered text output straight to a file descriptor: values are
+// formatted into one reusable buffer that is handed to write() only when
+// it fills up, so a large file costs a handful of system calls.
+class TextWriter {
+    public:
+        static constexpr size_t BUFFER_SIZE = 1 << 20;
+        // Longest "%f" rendering of a double: sign, 309 digits, point, 6 decimals.
+        static constexpr size_t MAX_FIXED = 320;
+
+        explicit TextWriter(const char* filename) : buffer(BUFFER_SIZE) {
+            fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd < 0) {
+                throw std::runtime_error("can't open file");
+            }
+        }
+        TextWriter(const TextWriter&) = delete;
+        TextWriter& operator=(const TextWriter&) = delete;
+        ~TextWriter() {
+            if (fd >= 0) {
+                try {
+                    flush();
+                } catch (...) {
+                }
+                ::close(fd);
+            }
+        }
+        // Makes sure at least bytes can be appended without flushing again.
+        void reserve(size_t bytes) {
+            if (buffer.size() - used < bytes) {
+                flush();
+                if (buffer.size() < bytes) {
+                    buffer.resize(bytes);
+                }
+            }
+        }
+        void put(char c) {
+            reserve(1);
+            buffer[used++] = c;
+        }
+        void append(std::string_view text) {
+            reserve(text.size());
+            std::copy(text.begin(), text.end(), buffer.begin() + used);
+            used += text.size();
+        }
+        // Same text as printf("%f", value).
+        void append_fixed(double value) {
+            reserve(MAX_FIXED);
+            char* first = buffer.data() + used;
+            auto result = std::to_chars(first, buffer.data() + buffer.size(), value, std::chars_format::fixed, 6);
+            used += result.ptr - first;
+        }
+        void flush() {
+            size_t done = 0;
+            while (done < used) {
+                ssize_t n = ::write(fd, buffer.data() + done, used - done);
+                if (n < 0) {
+                    used = 0;
+                    throw std::runtime_error("can't write file");
+                }
+                done += static_cast<size_t>(n);
+            }
+            used = 0;
+        }
+        void close() {
+            flush();
+            int result = ::close(fd);
+            fd = -1;
+            if (result != 0) {
+                throw std::runtime_error("can't write file");
+            }
+        }
+
+    private:
+        std::vector<char> buffer;
+        size_t used = 0;
+        int fd = -1;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run one job at a time. run() hands the
+// same job to every worker together with its index and returns once all of
+// them are done; the calling thread takes index 0.
+class ThreadPool {
+    public:
+        explicit ThreadPool(size_t threads) : count(threads ? threads : 1) {
+            for (size_t t = 1; t < count; ++t) {
+                workers.emplace_back([this, t] { worker_loop(t); });
+            }
+        }
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            start_cv.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+        size_t size() const { return count; }
+        void run(const std::function<void(size_t)>& job) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                current = &job;
+                pending = count - 1;
+                ++generation;
+            }
+            start_cv.notify_all();
+            job(0);
+            std::unique_lock<std::mutex> lock(mutex);
+            done_cv.wait(lock, [this] { return pending == 0; });
+        }
+
+    private:
+        void worker_loop(size_t index) {
+            size_t seen = 0;
+            while (true) {
+                const std::function<void(size_t)>* job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    start_cv.wait(lock, [&] { return stopping || generation != seen; });
+                    if (stopping) {
+                        return;
+                    }
+                    seen = generation;
+                    job = current;
+                }
+                (*job)(index);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    done_cv.notify_one();
+                }
+            }
+        }
+
+        size_t count;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable start_cv;
+        std::condition_variable done_cv;
+        const std::function<void(size_t)>* current = nullptr;
+        size_t pending = 0;
+        size_t generation = 0;
+        bool stopping = false;
+};
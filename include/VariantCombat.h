@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "Visitor.h"
+
+// NPCs stored by value; the alternative doubles as the kind. Plain NPCs
+// take part in no kill rule and have no alternative. The kill rules are
+// the default config, fixed at compile time; config kinds and rules need
+// CombatVisitor.
+using NPCVariant = std::variant<squirrel, werewolf, druid>;
+
+inline const NPC& as_npc(const NPCVariant& v) {
+    return std::visit([](const NPC& npc) -> const NPC& { return npc; }, v);
+}
+
+inline NPC& as_npc(NPCVariant& v) {
+    return std::visit([](NPC& npc) -> NPC& { return npc; }, v);
+}
+
+// Standalone copy of npc, throws for a plain NPC.
+inline NPCVariant make_variant(const NPC& npc) {
+    switch (npc.get_kind()) {
+        case NPCKind::squirrel: return static_cast<const squirrel&>(npc);
+        case NPCKind::werewolf: return static_cast<const werewolf&>(npc);
+        case NPCKind::druid: return static_cast<const druid&>(npc);
+        default: break;
+    }
+    throw std::logic_error("NPC " + std::string(npc.get_name()) + " has no variant kind");
+}
+
+inline std::vector<NPCVariant> to_variants(const NPC_array& arr) {
+    std::vector<NPCVariant> out;
+    out.reserve(arr.get_size());
+    for (const auto& npc : arr.get_npcs()) {
+        out.push_back(make_variant(*npc));
+    }
+    return out;
+}
+
+// KILL_MATRIX entry of a pair of NPC classes, known at compile time.
+template <typename Attacker, typename Target>
+constexpr bool kills_v = can_kill(Attacker::KIND, Target::KIND);
+
+// CombatVisitor's round over a vector of NPCVariant. std::visit on the
+// (attacker, target) pair jumps straight to one of nine instantiations;
+// pairs that cannot kill compile to nothing, the others inline the kill.
+// Kills, events and survivors match CombatVisitor on the same world.
+class VariantCombatVisitor : public NPCVisitor {
+    public:
+        void set_use_grid(bool use) { use_grid = use; }
+        void set_range_kernel(RangeKernel kernel) { range_mask = kernel; }
+        size_t get_round() const { return round; }
+        void do_combat(std::vector<NPCVariant>& npcs, double rad) {
+            ++round;
+            size_t n = npcs.size();
+            x.resize(n);
+            y.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                const NPC& npc = as_npc(npcs[i]);
+                x[i] = npc.get_x_cord();
+                y[i] = npc.get_y_cord();
+            }
+            double rad2 = rad * rad;
+            gridded = use_grid && grid.build(x.data(), y.data(), n, rad);
+            for (size_t i = 0; i < n; ++i) {
+                if (!as_npc(npcs[i]).is_alive_NPC()) {
+                    continue;
+                }
+                scan(i, rad2);
+                for (uint32_t j : hits) {
+                    std::visit([this](auto& attacker, auto& target) { fight(attacker, target); }, npcs[i], npcs[j]);
+                }
+            }
+            std::erase_if(npcs, [](const NPCVariant& v) { return !as_npc(v).is_alive_NPC(); });
+            finish_round(round, nullptr);
+        }
+
+    private:
+        template <typename Attacker, typename Target>
+        void fight(Attacker& attacker, Target& target) {
+            if constexpr (kills_v<Attacker, Target>) {
+                if (attacker.is_alive_NPC() && target.is_alive_NPC()) {
+                    target.kill_npc();
+                    notify(CombatEvent{attacker.get_name(), target.get_name(), Attacker::KIND, Target::KIND,
+                                       attacker.get_x_cord(), attacker.get_y_cord(),
+                                       target.get_x_cord(), target.get_y_cord(), round});
+                }
+            }
+        }
+
+        // Targets in range of attacker i, in vector order.
+        void scan(size_t i, double rad2) {
+            hits.clear();
+            double ax = x[i];
+            double ay = y[i];
+            if (gridded) {
+                const uint32_t* order = grid.get_order();
+                const double* gx = grid.get_x();
+                const double* gy = grid.get_y();
+                grid.for_each_neighbor_run(ax, ay, [&](size_t first, size_t last) {
+                    for (size_t k = first; k < last; k += RANGE_BLOCK) {
+                        uint32_t mask = range_mask(ax, ay, gx + k, gy + k, std::min(RANGE_BLOCK, last - k), rad2);
+                        for (; mask; mask &= mask - 1) {
+                            uint32_t j = order[k + __builtin_ctz(mask)];
+                            if (j != i) {
+                                hits.push_back(j);
+                            }
+                        }
+                    }
+                });
+                std::sort(hits.begin(), hits.end());
+                return;
+            }
+            size_t n = x.size();
+            for (size_t k = 0; k < n; k += RANGE_BLOCK) {
+                uint32_t mask = range_mask(ax, ay, x.data() + k, y.data() + k, std::min(RANGE_BLOCK, n - k), rad2);
+                for (; mask; mask &= mask - 1) {
+                    size_t j = k + __builtin_ctz(mask);
+                    if (j != i) {
+                        hits.push_back(static_cast<uint32_t>(j));
+                    }
+                }
+            }
+        }
+
+        size_t round = 0;
+        bool use_grid = true;
+        bool gridded = false;
+        RangeKernel range_mask = select_range_kernel();
+        UniformGrid grid;
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<uint32_t> hits;
+};
@@ -1,9 +1,12 @@
 #pragma once
+#include <array>
 #include <cstddef>
 #include <cstring>
 #include <list>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
+#include <typeinfo>
 #include <iostream>
 #include <memory>
 #include <cstdio>
@@ -11,79 +14,548 @@
 #include <cmath>
 #include "NPC.h"
 #include "Observer.h"
+#include "Grid.h"
+#include "KdTree.h"
+#include "Movement.h"
+#include "Columns.h"
+#include "EventBus.h"
+#include "Simd.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+// Default rules between built-in kinds, at compile time; combat itself
+// consults active_rules().
+constexpr bool can_kill(NPCKind attacker, NPCKind target) {
+    return KILL_MATRIX[static_cast<size_t>(attacker)][static_cast<size_t>(target)];
+}
 
 class NPCVisitor {
     public:
-        virtual ~NPCVisitor() = default;
-        virtual void visit_squirrel(std::list<std::string>& to_delete, 
-                                std::unique_ptr<NPC>& attacker, 
-                                std::unique_ptr<NPC>& target) {}
-        virtual void visit_werewolf(std::list<std::string>& to_delete, 
-                                std::unique_ptr<NPC>& attacker, 
-                                std::unique_ptr<NPC>& target) {}
-        virtual void visit_druid(std::list<std::string>& to_delete, 
-                                std::unique_ptr<NPC>& attacker, 
-                                std::unique_ptr<NPC>& target) {}
+        virtual ~NPCVisitor() { publish_events(); }
+        virtual void visit_squirrel(std::vector<uint32_t>& to_delete, 
+                                NPC_ptr& attacker, 
+                                NPC_ptr& target) {}
+        virtual void visit_werewolf(std::vector<uint32_t>& to_delete, 
+                                NPC_ptr& attacker, 
+                                NPC_ptr& target) {}
+        virtual void visit_druid(std::vector<uint32_t>& to_delete, 
+                                NPC_ptr& attacker, 
+                                NPC_ptr& target) {}
+        // Plain NPCs and kinds declared in the kill-rule config.
+        virtual void visit_npc(std::vector<uint32_t>& to_delete, 
+                                NPC_ptr& attacker, 
+                                NPC_ptr& target) {}
         void add_observer(std::unique_ptr<Observer>&& obs) {  
+            if (bus) {
+                bus->subscribe(std::move(obs));
+                return;
+            }
             observer_array.push_back(std::move(obs));
         }
+        // With the bus on, events are collected into a batch per round and
+        // every observer handles the batches on its own thread, in order,
+        // so combat never waits for an observer. Turning it off delivers
+        // what is queued and makes the observers synchronous again.
+        void set_event_bus(bool on) {
+            if (on == static_cast<bool>(bus)) {
+                return;
+            }
+            if (on) {
+                bus = std::make_unique<EventBus>();
+                for (auto& obs : observer_array) {
+                    bus->subscribe(std::move(obs));
+                }
+                observer_array.clear();
+                return;
+            }
+            publish_events();
+            for (auto& obs : bus->close()) {
+                observer_array.push_back(std::move(obs));
+            }
+            bus.reset();
+        }
+        bool has_event_bus() const { return static_cast<bool>(bus); }
+        // Hands the events collected so far to the bus.
+        void publish_events() {
+            if (bus && !pending.empty()) {
+                bus->publish(std::move(pending));
+                pending = EventBatch{};
+            }
+        }
+        // Blocks until the observers have handled everything published.
+        void flush_observers() {
+            if (bus) {
+                bus->flush();
+            }
+        }
         void notify(const std::string& event) {
+            PhaseTimer timer(notify_ns);
+            count_event();
+            if (bus) {
+                publish_events();
+                pending.messages.push_back(event);
+                publish_events();
+                return;
+            }
+            for (auto& obs : observer_array) {
+                obs->update(event);
+            }
+        }
+        void notify(const CombatEvent& event) {
+            PhaseTimer timer(notify_ns);
+            count_event();
+            if (bus) {
+                pending.round = event.round;
+                pending.add(event);
+                return;
+            }
             for (auto& obs : observer_array) {
                 obs->update(event);
             }
         }
+    protected:
+        // Running totals over all notify() calls.
+        uint64_t get_notify_ns() const { return notify_ns; }
+        uint64_t get_events() const { return events; }
+        uint64_t logged_bytes() const {
+            uint64_t bytes = 0;
+            for (auto& obs : observer_array) {
+                bytes += obs->get_logger_stats().bytes;
+            }
+            return bytes;
+        }
+        // Ends a round: the bus gets its batch, stats (if any) go with it.
+        void finish_round(size_t round, const CombatStats* stats) {
+            if (!bus) {
+                if (stats) {
+                    for (auto& obs : observer_array) {
+                        obs->round_done(*stats);
+                    }
+                }
+                return;
+            }
+            if (stats) {
+                pending.has_stats = true;
+                pending.stats = *stats;
+            }
+            pending.round = round;
+            publish_events();
+        }
     private:
+        void count_event() {
+            if constexpr (STATS_ENABLED) {
+                ++events;
+            }
+        }
+
         std::list<std::unique_ptr<Observer>> observer_array;
+        EventBatch pending;
+        uint64_t notify_ns = 0;
+        uint64_t events = 0;
+        // declared last so its threads stop before the rest goes away
+        std::unique_ptr<EventBus> bus;
 };
 
+// Calls visit_* for every live pair in range, attackers in array order;
+// its own visit_* kill what the active rules allow. Subclasses may
+// override them and see every such pair, including the ones that can't
+// kill.
 class CombatVisitor : public NPCVisitor{
     public:
-        std::string combat_event_string(std::unique_ptr<NPC>& npc, std::unique_ptr<NPC>& to_npc) {
-            std::string event = "NPC " + to_npc->get_type() + " " + to_npc->get_name() + 
-                            " убит. Убийца: " + npc->get_type() + " " + npc->get_name() + ".";
-            return event;
+        CombatEvent combat_event(NPC_ptr& npc, NPC_ptr& to_npc) const {
+            return CombatEvent{npc->get_name(), to_npc->get_name(), npc->get_kind(), to_npc->get_kind(),
+                               npc->get_x_cord(), npc->get_y_cord(),
+                               to_npc->get_x_cord(), to_npc->get_y_cord(), round};
+        }
+        std::string combat_event_string(NPC_ptr& npc, NPC_ptr& to_npc) {
+            return format_event(combat_event(npc, to_npc));
+        }
+        void visit_squirrel(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc) override{
+            strike(to_delete, npc, to_npc);
+        }
+        void visit_werewolf(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc) override{
+            strike(to_delete, npc, to_npc);
+        }
+        void visit_druid(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc) override{
+            strike(to_delete, npc, to_npc);
+        }
+        void visit_npc(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc) override{
+            strike(to_delete, npc, to_npc);
+        }
+        CombatVisitor(size_t threads = 1) { set_threads(threads); clear_kind_radii(); }
+        // Without an index every attacker tests every NPC.
+        void set_use_grid(bool use) { use_grid = use; }
+        // Attackers of the kind reach rad instead of the round's radius.
+        // Rounds with mixed radii search a k-d tree, since the grid's cells
+        // fit one radius, and always run in full.
+        void set_kind_radius(NPCKind kind, double rad) { kind_radius[static_cast<size_t>(kind)] = rad; }
+        void clear_kind_radii() { kind_radius.fill(NAN); }
+        // The k-d tree even when all attackers share the radius.
+        void set_use_tree(bool use) { use_tree = use; }
+        // The farthest any attacker reaches in a round at rad. Ranges are
+        // compared squared, so a negative radius reaches as far as its
+        // magnitude.
+        double reach(double rad) const {
+            double far = std::fabs(rad);
+            for (double r : kind_radius){
+                if (std::fabs(r) > far){
+                    far = std::fabs(r);
+                }
+            }
+            return far;
+        }
+        void set_range_kernel(RangeKernel kernel) { range_mask = kernel; }
+        // Rounds on an array that is settled at the same radius, under the
+        // same kill rules, only test pairs with a dirty NPC; the outcome
+        // equals a full round. Subclasses may kill outside the rules, so
+        // their rounds are always full and leave the array unsettled.
+        void set_incremental(bool on) { incremental = on; }
+        // The stage moves the NPCs at the start of every round.
+        void set_movement(std::unique_ptr<MovementStage>&& stage) { movement = std::move(stage); }
+        void set_threads(size_t threads) {
+            pool = threads > 1 ? std::make_unique<ThreadPool>(threads) : nullptr;
+        }
+        size_t get_threads() const { return pool ? pool->size() : 1; }
+        size_t get_round() const { return round; }
+        // Stats of the last round; all zero unless built with NPC_STATS=1.
+        const CombatStats& get_stats() const { return stats; }
+        // Name ids of the NPCs killed in the last round, or in the last
+        // attack_range() window, in kill order.
+        const std::vector<uint32_t>& get_victims() const { return to_delete; }
+        void do_combat(NPC_array& arr, double rad){
+            begin_round();
+            stats = CombatStats{};
+            uint64_t notify_before = get_notify_ns();
+            uint64_t events_before = get_events();
+            uint64_t bytes_before = 0;
+            uint64_t allocations_before = 0;
+            if constexpr (STATS_ENABLED){
+                stats.round = round;
+                bytes_before = logged_bytes();
+                allocations_before = stats_allocations();
+            }
+            {
+                PhaseTimer total(stats.total_ns);
+                to_delete.clear();
+                if (movement){
+                    PhaseTimer timer(stats.movement_ns);
+                    movement->step(arr);
+                }
+                std::vector<NPC_ptr>* npcs;
+                {
+                    PhaseTimer timer(stats.columns_ns);
+                    npcs = &arr.get_npcs();
+                    columns.assign(arr);
+                }
+                size_t n = columns.size();
+                double rad2 = rad * rad;
+                {
+                    PhaseTimer timer(stats.grid_ns);
+                    build_index(rad);
+                }
+                {
+                    PhaseTimer timer(stats.scan_ns);
+                    if (incremental && !mixed_radii && !every_pair && arr.get_settled_radius() == rad
+                        && arr.get_settled_rules() == rules->get_id()){
+                        combat_dirty(to_delete, *npcs, rad2);
+                    }
+                    else {
+                        combat_range(to_delete, *npcs, rad2, 0, n);
+                    }
+                }
+                {
+                    PhaseTimer timer(stats.cleanup_ns);
+                    for (uint32_t d : columns.dirty){
+                        (*npcs)[d]->mark_clean();
+                    }
+                    arr.set_settled_radius(mixed_radii || every_pair ? NAN : rad, rules->get_id());
+                    arr.erase_dead();
+                }
+                if constexpr (STATS_ENABLED){
+                    stats.npcs = n;
+                }
+            }
+            if constexpr (STATS_ENABLED){
+                // scan_ns covered the whole fight loop, fight_ns every fight
+                stats.notify_ns = get_notify_ns() - notify_before;
+                stats.scan_ns -= stats.fight_ns;
+                stats.fight_ns -= stats.notify_ns;
+                stats.events = get_events() - events_before;
+                stats.bytes_logged = logged_bytes() - bytes_before;
+                stats.allocations = stats_allocations() - allocations_before;
+                finish_round(round, &stats);
+            }
+            else {
+                finish_round(round, nullptr);
+            }
         }
-        void visit_squirrel(std::list<std::string>& to_delete, std::unique_ptr<NPC>& npc, std::unique_ptr<NPC>& to_npc) override{
-            if (to_npc->get_type() == "druid" || to_npc->get_type() == "werewolf"){
+        // Streaming rounds over a window of a larger world: start_round()
+        // once per round, then attack_range() per window. Only NPCs
+        // [first, last) of arr attack, any NPC of arr can be hit, and the
+        // dead stay in arr until the caller erases them.
+        void start_round() {
+            begin_round();
+            to_delete.clear();
+        }
+        void attack_range(NPC_array& arr, size_t first, size_t last, double rad){
+            // ids refer to this window's names, which the caller may rebuild
+            to_delete.clear();
+            auto& npcs = arr.get_npcs();
+            columns.assign(arr);
+            build_index(rad);
+            combat_range(to_delete, npcs, rad * rad, first, std::min(last, columns.size()));
+        }
+    private:
+        static constexpr size_t PARALLEL_BLOCK = 8192;
+
+        void strike(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc){
+            if (kills(npc->get_kind(), to_npc->get_kind())){
                 to_npc->kill_npc();
-                to_delete.push_back(to_npc->get_name());
-                notify(combat_event_string(npc, to_npc));
+                to_delete.push_back(to_npc->get_name_id());
+                notify(combat_event(npc, to_npc));
+            }
+        }
+        bool kills(NPCKind attacker, NPCKind target) const {
+            return rules->kills(static_cast<size_t>(attacker), static_cast<size_t>(target));
+        }
+        // Whether the pair reaches visit_*. The visit_* of CombatVisitor
+        // only strike, so it skips pairs that can't kill; a subclass gets
+        // every live pair in range, as the visitor always did.
+        bool may_fight(NPCKind attacker, NPCKind target) const {
+            return every_pair || kills(attacker, target);
+        }
+        void begin_round(){
+            ++round;
+            rules = &active_rules();
+            every_pair = typeid(*this) != typeid(CombatVisitor);
+        }
 
+        // Squared radius per attacker kind, and the index that suits them.
+        void build_index(double rad){
+            mixed_radii = false;
+            for (size_t k = 0; k < kind_radius.size(); ++k){
+                bool own = !std::isnan(kind_radius[k]);
+                kind_rad2[k] = own ? kind_radius[k] * kind_radius[k] : rad * rad;
+                mixed_radii |= own && std::fabs(kind_radius[k]) != std::fabs(rad);
             }
+            const double* xs = columns.x.data();
+            const double* ys = columns.y.data();
+            treed = use_grid && (mixed_radii || use_tree) && tree.build(xs, ys, columns.size());
+            gridded = use_grid && !treed && !mixed_radii && grid.build(xs, ys, columns.size(), rad);
         }
-        void visit_werewolf(std::list<std::string>& to_delete, std::unique_ptr<NPC>& npc, std::unique_ptr<NPC>& to_npc) override{
-            if (to_npc->get_type() == "druid"){
-                to_npc->kill_npc();
-                to_delete.push_back(to_npc->get_name());
-                notify(combat_event_string(npc, to_npc));
+
+        // Attackers [first, last) in array order against every NPC.
+        void combat_range(std::vector<uint32_t>& to_delete, std::vector<NPC_ptr>& npcs, double rad2,
+                          size_t first, size_t last){
+            if (pool){
+                combat_parallel(to_delete, npcs, rad2, first, last);
+                return;
+            }
+            std::vector<uint32_t>& hits = dirty_hits;
+            for (size_t i = first; i < last; ++i){
+                scan(i, rad2, hits, stats.pairs_tested);
+                count_hits(hits);
+                for (uint32_t j : hits){
+                    fight(to_delete, npcs, i, j);
+                }
             }
         }
-        void visit_druid(std::list<std::string>& to_delete, std::unique_ptr<NPC>& npc, std::unique_ptr<NPC>& to_npc) override{}
-        void do_combat(NPC_array& arr, double rad){
-            std::list<std::string> to_delete;
-            for (auto& npc : arr.get_npcs()){
-                for (auto& to_npc : arr.get_npcs()){
-                    if (npc.get() == to_npc.get()) {
-                        continue;
+
+        // Collects the targets in range of attacker i, in array order, and
+        // adds the number of distance tests to tested.
+        void scan(size_t i, double rad2, std::vector<uint32_t>& hits, uint64_t& tested) const {
+            hits.clear();
+            const double* xs = columns.x.data();
+            const double* ys = columns.y.data();
+            double ax = xs[i];
+            double ay = ys[i];
+            if (mixed_radii){
+                rad2 = kind_rad2[static_cast<size_t>(columns.kind[i])];
+            }
+            if (gridded || treed){
+                const uint32_t* order = treed ? tree.get_order() : grid.get_order();
+                const double* gx = treed ? tree.get_x() : grid.get_x();
+                const double* gy = treed ? tree.get_y() : grid.get_y();
+                auto test_run = [&](size_t first, size_t last){
+                    for (size_t k = first; k < last; k += RANGE_BLOCK){
+                        size_t count = std::min(RANGE_BLOCK, last - k);
+                        if constexpr (STATS_ENABLED){
+                            tested += count;
+                        }
+                        uint32_t mask = range_mask(ax, ay, gx + k, gy + k, count, rad2);
+                        for (; mask; mask &= mask - 1){
+                            uint32_t j = order[k + __builtin_ctz(mask)];
+                            if (j != i){
+                                hits.push_back(j);
+                            }
+                        }
                     }
-                    if (((((npc->get_x_cord() - to_npc->get_x_cord()) * (npc->get_x_cord() - to_npc->get_x_cord())) +
-                    ((npc->get_y_cord() - to_npc->get_y_cord()) * (npc->get_y_cord() - to_npc->get_y_cord()))) 
-                    <= (rad * rad)) && (npc->is_alive_NPC() && to_npc->is_alive_NPC())){
-                        if (npc->get_type() == "squirrel"){
-                            visit_squirrel(to_delete, npc, to_npc);
+                };
+                if (treed){
+                    tree.for_each_leaf_run(ax, ay, rad2, test_run);
+                }
+                else {
+                    grid.for_each_neighbor_run(ax, ay, test_run);
+                }
+                std::sort(hits.begin(), hits.end());
+                return;
+            }
+            size_t n = columns.size();
+            for (size_t k = 0; k < n; k += RANGE_BLOCK){
+                size_t count = std::min(RANGE_BLOCK, n - k);
+                if constexpr (STATS_ENABLED){
+                    tested += count;
+                }
+                uint32_t mask = range_mask(ax, ay, xs + k, ys + k, count, rad2);
+                for (; mask; mask &= mask - 1){
+                    size_t j = k + __builtin_ctz(mask);
+                    if (j != i){
+                        hits.push_back(static_cast<uint32_t>(j));
+                    }
+                }
+            }
+        }
+
+        // Attackers are processed in blocks. Workers scan their share of a
+        // block against the liveness frozen at the block start and record
+        // (attacker, target) intents; the intents are then replayed serially
+        // in attacker order. NPCs never come back to life, so dropping pairs
+        // that were already dead cannot change the outcome, and kills and
+        // events match the single-threaded loop exactly.
+        void combat_parallel(std::vector<uint32_t>& to_delete, std::vector<NPC_ptr>& npcs, double rad2,
+                             size_t first, size_t last){
+            size_t threads = pool->size();
+            intents.resize(threads);
+            scratch.resize(threads);
+            scan_counts.assign(threads, {0, 0});
+            size_t block = gridded || treed ? PARALLEL_BLOCK : threads * 16;
+            for (size_t a0 = first; a0 < last; a0 += block){
+                size_t a1 = std::min(last, a0 + block);
+                size_t share = (a1 - a0 + threads - 1) / threads;
+                pool->run([&](size_t t){
+                    auto& out = intents[t];
+                    auto& hits = scratch[t];
+                    auto& [tested, in_range] = scan_counts[t];
+                    out.clear();
+                    size_t end = std::min(a1, a0 + (t + 1) * share);
+                    for (size_t i = a0 + t * share; i < end; ++i){
+                        if (!columns.is_alive(i)){
+                            continue;
                         }
-                        if (npc->get_type() == "werewolf"){
-                            visit_werewolf(to_delete, npc, to_npc);
+                        scan(i, rad2, hits, tested);
+                        if constexpr (STATS_ENABLED){
+                            in_range += hits.size();
                         }
-                        if (npc->get_type() == "druid"){
-                            visit_druid(to_delete, npc, to_npc);
+                        NPCKind attacker = columns.kind[i];
+                        for (uint32_t j : hits){
+                            if (columns.is_alive(j) && may_fight(attacker, columns.kind[j])){
+                                out.emplace_back(static_cast<uint32_t>(i), j);
+                            }
                         }
                     }
+                });
+                for (auto& out : intents){
+                    for (auto [i, j] : out){
+                        fight(to_delete, npcs, i, j);
+                    }
                 }
             }
-            for(auto& cur: to_delete){
-                arr.remove_npc(cur);
+            if constexpr (STATS_ENABLED){
+                for (auto [tested, in_range] : scan_counts){
+                    stats.pairs_tested += tested;
+                    stats.pairs_in_range += in_range;
+                }
             }
         }
-};
 
+        // After a full round no two survivors within rad can fight: the
+        // attacker's turn would have killed the target. So every kill of
+        // the next round involves an NPC that moved or spawned since, and
+        // replaying just those pairs in (attacker, target) order gives the
+        // same kills and events as a full round.
+        void combat_dirty(std::vector<uint32_t>& to_delete, std::vector<NPC_ptr>& npcs, double rad2){
+            pairs.clear();
+            std::vector<uint32_t>& hits = dirty_hits;
+            for (uint32_t d : columns.dirty){
+                if (!columns.is_alive(d)){
+                    continue;
+                }
+                scan(d, rad2, hits, stats.pairs_tested);
+                count_hits(hits);
+                for (uint32_t j : hits){
+                    if (!columns.is_alive(j)){
+                        continue;
+                    }
+                    if (may_fight(columns.kind[d], columns.kind[j])){
+                        pairs.emplace_back(d, j);
+                    }
+                    if (may_fight(columns.kind[j], columns.kind[d])){
+                        pairs.emplace_back(j, d);
+                    }
+                }
+            }
+            std::sort(pairs.begin(), pairs.end());
+            pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+            for (auto [i, j] : pairs){
+                fight(to_delete, npcs, i, j);
+            }
+        }
+
+        void fight(std::vector<uint32_t>& to_delete, std::vector<NPC_ptr>& npcs, size_t i, size_t j){
+            if (!columns.is_alive(i) || !columns.is_alive(j) || !may_fight(columns.kind[i], columns.kind[j])){
+                return;
+            }
+            PhaseTimer timer(stats.fight_ns);
+            switch (columns.kind[i]){
+                case NPCKind::squirrel:
+                    visit_squirrel(to_delete, npcs[i], npcs[j]);
+                    break;
+                case NPCKind::werewolf:
+                    visit_werewolf(to_delete, npcs[i], npcs[j]);
+                    break;
+                case NPCKind::druid:
+                    visit_druid(to_delete, npcs[i], npcs[j]);
+                    break;
+                default:
+                    visit_npc(to_delete, npcs[i], npcs[j]);
+                    break;
+            }
+            if (!npcs[j]->is_alive_NPC()){
+                columns.kill(j);
+                if constexpr (STATS_ENABLED){
+                    ++stats.kills;
+                }
+            }
+        }
+
+        void count_hits(const std::vector<uint32_t>& hits){
+            if constexpr (STATS_ENABLED){
+                stats.pairs_in_range += hits.size();
+            }
+        }
+
+        size_t round = 0;
+        std::vector<uint32_t> to_delete;  // name ids of this round's (or window's) victims
+        bool use_grid = true;
+        bool use_tree = false;
+        bool incremental = false;
+        bool every_pair = false;
+        bool gridded = false;
+        bool treed = false;
+        bool mixed_radii = false;
+        std::array<double, KillRules::MAX_KINDS> kind_radius;  // NaN: the round's radius
+        std::array<double, KillRules::MAX_KINDS> kind_rad2;
+        const KillRules* rules = &active_rules();
+        RangeKernel range_mask = select_range_kernel();
+        UniformGrid grid;
+        KdTree tree;
+        NPC_columns columns;
+        std::unique_ptr<ThreadPool> pool;
+        std::unique_ptr<MovementStage> movement;
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> intents;
+        std::vector<std::vector<uint32_t>> scratch;
+        std::vector<std::pair<uint32_t, uint32_t>> pairs;
+        std::vector<uint32_t> dirty_hits;
+        std::vector<std::pair<uint64_t, uint64_t>> scan_counts;  // per thread: tested, in range
+        CombatStats stats;
+};
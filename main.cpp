@@ -1,11 +1,17 @@
 #include "include/NPC.h"
 #include "include/Observer.h"
+#include "include/Rules.h"
 #include "include/Visitor.h"
 
+#include <fstream>
+
 int main() {
+    if (std::ifstream("rules.txt")) {
+        active_rules() = KillRules::load("rules.txt");
+    }
     NPC_array npcs;
     CombatVisitor combat;
-    combat.add_observer(std::make_unique<FileLogger>("log.txt"));
+    combat.add_observer(std::make_unique<AsyncFileLogger>("log.txt"));
     combat.add_observer(std::make_unique<Display>());
     NPCFactory::load_from_file_c_style("npc.txt", npcs);
     std::cout << "=== До боя ===" << std::endl;
@@ -2,8 +2,14 @@
 #include "../include/NPC.h"
 #include "../include/Observer.h"
 #include "../include/Visitor.h"
+#include "../include/VariantCombat.h"
+#include "../include/Streaming.h"
+#include "../include/KdTree.h"
 
+#include <chrono>
 #include <fstream>
+#include <random>
+#include <thread>
 
 // ==================== Тесты NPC ====================
 
@@ -65,6 +71,26 @@ TEST(DruidTest, TypeCheck) {
     ASSERT_EQ(dr.get_name(), "Друид1");
 }
 
+TEST(KindTest, TagsMatchTypes) {
+    ASSERT_EQ(NPC().get_kind(), NPCKind::npc);
+    ASSERT_EQ(squirrel("Белка1", 1, 2).get_kind(), NPCKind::squirrel);
+    ASSERT_EQ(werewolf().get_kind(), NPCKind::werewolf);
+    ASSERT_EQ(NPCFactory::create_npc("druid", "Друид1", 1, 2)->get_kind(), NPCKind::druid);
+    werewolf original("Оборотень1", 1, 2);
+    werewolf copy(original);
+    ASSERT_EQ(copy.get_kind(), NPCKind::werewolf);
+}
+
+TEST(KindTest, KillMatrix) {
+    static_assert(can_kill(NPCKind::squirrel, NPCKind::werewolf));
+    static_assert(can_kill(NPCKind::squirrel, NPCKind::druid));
+    static_assert(can_kill(NPCKind::werewolf, NPCKind::druid));
+    static_assert(!can_kill(NPCKind::werewolf, NPCKind::squirrel));
+    static_assert(!can_kill(NPCKind::druid, NPCKind::squirrel));
+    static_assert(!can_kill(NPCKind::squirrel, NPCKind::squirrel));
+    ASSERT_FALSE(can_kill(NPCKind::npc, NPCKind::druid));
+}
+
 // ==================== Тесты NPCFactory ====================
 
 TEST(NPCFactoryTest, CreateSquirrel) {
@@ -142,13 +168,203 @@ TEST(NPCArrayTest, RemoveByName) {
     ASSERT_EQ(arr.get_size(), 1);
 }
 
+TEST(NPCArrayTest, NamesAreInterned) {
+    NPC_array arr;
+    arr.emplace_npc(NPCKind::squirrel, "Белка", 1, 2);
+    arr.emplace_npc(NPCKind::druid, "Белка", 3, 4);
+    arr.add_NPC(std::make_unique<werewolf>("Оборотень1", 5, 6));
+    auto& npcs = arr.get_npcs();
+    ASSERT_EQ(arr.get_names().size(), 2);
+    ASSERT_EQ(npcs[0]->get_name_id(), npcs[1]->get_name_id());
+    ASSERT_EQ(npcs[0]->get_name().data(), npcs[1]->get_name().data());
+    ASSERT_EQ(npcs[2]->get_name(), "Оборотень1");
+    ASSERT_EQ(arr.get_names().find("Оборотень1"), npcs[2]->get_name_id());
+    ASSERT_EQ(arr.get_names().find("Нет такого"), NameTable::NO_NAME);
+
+    npcs[2]->set_name("Белка");
+    ASSERT_EQ(npcs[2]->get_name_id(), npcs[0]->get_name_id());
+}
+
+TEST(NPCArrayTest, RemoveById) {
+    NPC_array arr;
+    arr.emplace_npc(NPCKind::squirrel, "Белка", 1, 2);
+    arr.emplace_npc(NPCKind::werewolf, "Оборотень1", 3, 4);
+    arr.emplace_npc(NPCKind::druid, "Белка", 5, 6);
+    arr.remove_npc_id(arr.get_names().find("Белка"));
+    ASSERT_EQ(arr.get_size(), 1);
+    ASSERT_EQ(arr.get_npcs()[0]->get_name(), "Оборотень1");
+    arr.remove_npc("Нет такого");
+    ASSERT_EQ(arr.get_size(), 1);
+}
+
+TEST(NPCArrayTest, NamesReclaimedOnlyByClear) {
+    NPC_array arr;
+    arr.emplace_npc(NPCKind::squirrel, "Белка", 1, 2);
+    arr.emplace_npc(NPCKind::werewolf, "Оборотень1", 3, 4);
+    arr.remove_npc("Белка");
+    // id удалённой белки остаётся действительным
+    ASSERT_EQ(arr.get_names().size(), 2);
+    ASSERT_EQ(arr.get_names().get(arr.get_names().find("Белка")), "Белка");
+    arr.clear();
+    ASSERT_EQ(arr.get_names().size(), 0);
+}
+
+TEST(NPCArrayTest, NPCOutsideArrayOwnsName) {
+    squirrel sq("Белка1", 1, 2);
+    ASSERT_EQ(sq.get_name_id(), NameTable::NO_NAME);
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>(sq));
+    squirrel copy(static_cast<const squirrel&>(*arr.get_npcs()[0]));
+    arr.clear();
+    ASSERT_EQ(copy.get_name(), "Белка1");
+    ASSERT_EQ(copy.get_name_id(), NameTable::NO_NAME);
+}
+
+TEST(NPCArrayTest, IndexedRemovals) {
+    NPC_array plain, indexed;
+    indexed.set_indexed(true);
+    std::mt19937 gen(3);
+    for (int i = 0; i < 2000; ++i) {
+        // немного совпадающих имён и координат
+        std::string name = "npc" + std::to_string(gen() % 500);
+        double x = gen() % 40, y = gen() % 40;
+        NPCKind kind = static_cast<NPCKind>(1 + gen() % 3);
+        plain.emplace_npc(kind, name, x, y);
+        indexed.emplace_npc(kind, name, x, y);
+    }
+    auto same = [&] {
+        ASSERT_EQ(plain.get_size(), indexed.get_size());
+        for (size_t i = 0; i < plain.get_size(); ++i) {
+            const NPC& a = *plain.get_npcs()[i];
+            const NPC& b = *indexed.get_npcs()[i];
+            ASSERT_TRUE(a == b);
+        }
+    };
+    for (int step = 0; step < 300; ++step) {
+        std::string name = "npc" + std::to_string(gen() % 500);
+        double x = gen() % 40, y = gen() % 40;
+        switch (step % 5) {
+            case 0:
+                plain.remove_npc(name);
+                indexed.remove_npc(name);
+                break;
+            case 1:
+                plain.remove_at(x, y);
+                indexed.remove_at(x, y);
+                break;
+            case 2:
+                plain.emplace_npc(NPCKind::druid, name, x, y);
+                indexed.emplace_npc(NPCKind::druid, name, x, y);
+                break;
+            case 3:
+                if (plain.get_size()) {
+                    size_t k = gen() % plain.get_size();
+                    plain.get_npcs()[k]->set_x(x);
+                    indexed.get_npcs()[k]->set_x(x);
+                    plain.get_npcs()[k]->set_name(name);
+                    indexed.get_npcs()[k]->set_name(name);
+                }
+                break;
+            case 4:
+                plain.remove_at(-0.0, 0);
+                indexed.remove_at(-0.0, 0);
+                break;
+        }
+        if (step % 50 == 0) {
+            same();
+        }
+    }
+    same();
+
+    CombatVisitor combat;
+    combat.do_combat(plain, 3);
+    combat.do_combat(indexed, 3);
+    plain.remove_npc("npc7");
+    indexed.remove_npc("npc7");
+    same();
+}
+
+TEST(NPCArrayTest, EraseDead) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 100, 200));
+    arr.add_NPC(std::make_unique<werewolf>("Оборотень1", 150, 250));
+    arr.add_NPC(std::make_unique<druid>("Друид1", 200, 300));
+    arr.get_npcs()[0]->kill_npc();
+    arr.get_npcs()[2]->kill_npc();
+
+    ASSERT_EQ(arr.erase_dead(), 2);
+    ASSERT_EQ(arr.get_size(), 1);
+    ASSERT_EQ(arr.get_npcs()[0]->get_name(), "Оборотень1");
+}
+
+TEST(NPCArrayTest, PooledNPCs) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 1, 2));
+    NPC& ww = arr.emplace_npc(NPCKind::werewolf, "Оборотень1", 150, 250);
+    ASSERT_EQ(ww.get_type(), "werewolf");
+    ASSERT_EQ(ww.get_name(), "Оборотень1");
+    ASSERT_EQ(arr.get_pool_chunks(), 1);
+
+    // место погибшего оборотня используется повторно
+    const NPC* old_slot = &ww;
+    ww.kill_npc();
+    arr.erase_dead();
+    NPC& again = arr.emplace_npc(NPCKind::werewolf, "Оборотень2", 1, 1);
+    ASSERT_EQ(&again, old_slot);
+    ASSERT_EQ(arr.get_pool_chunks(), 1);
+
+    for (int i = 0; i < 5000; ++i) {
+        arr.emplace_npc(NPCKind::druid, "Друид", i % 500, 0);
+    }
+    ASSERT_EQ(arr.get_size(), 5002);
+    ASSERT_EQ(arr.get_pool_chunks(), 3);
+
+    arr.clear();
+    ASSERT_EQ(arr.get_size(), 0);
+    ASSERT_EQ(arr.get_pool_chunks(), 0);
+    arr.emplace_npc(NPCKind::squirrel, "Белка2", 5, 5);
+    ASSERT_EQ(arr.get_size(), 1);
+}
+
+TEST(NPCArrayTest, MovedArrayKeepsPools) {
+    NPC_array arr;
+    arr.emplace_npc(NPCKind::druid, "Друид1", 1, 2);
+    NPC_array moved(std::move(arr));
+    moved.get_npcs()[0]->kill_npc();
+    ASSERT_EQ(moved.erase_dead(), 1);
+    arr.clear();
+}
+
+TEST(NPCArrayTest, MovedFromArrayStaysUsable) {
+    NPC_array arr, target;
+    arr.emplace_npc(NPCKind::druid, "Друид1", 1, 2);
+    target.emplace_npc(NPCKind::squirrel, "Белка1", 3, 4);
+    NPC_array moved(std::move(arr));
+    arr.emplace_npc(NPCKind::werewolf, "Оборотень1", 5, 6);
+    arr.add_NPC(std::make_unique<squirrel>("Белка2", 7, 8));
+    ASSERT_EQ(arr.get_size(), 2);
+    ASSERT_EQ(arr.get_npcs()[0]->get_name(), "Оборотень1");
+
+    target = std::move(moved);
+    ASSERT_EQ(target.get_size(), 1);
+    ASSERT_EQ(target.get_npcs()[0]->get_name(), "Друид1");
+    ASSERT_EQ(moved.get_size(), 0);
+    moved.emplace_npc(NPCKind::druid, "Друид2", 9, 9);
+    ASSERT_EQ(moved.get_npcs()[0]->get_name(), "Друид2");
+}
+
 TEST(NPCArrayTest, Clear) {
     NPC_array arr;
     arr.add_NPC(std::make_unique<squirrel>("Белка1", 100, 200));
     arr.add_NPC(std::make_unique<werewolf>("Оборотень1", 150, 250));
+    // вперемешку с NPC из пула
+    arr.emplace_npc(NPCKind::druid, "Друид1", 1, 2);
+    arr.remove_npc("Белка1");
     
     arr.clear();
     ASSERT_EQ(arr.get_size(), 0);
+    arr.emplace_npc(NPCKind::druid, "Друид1", 1, 2);
+    ASSERT_EQ(arr.get_npcs()[0]->get_name(), "Друид1");
 }
 
 TEST(NPCArrayTest, PrintAll) {
@@ -186,6 +402,33 @@ TEST(FileOperationsTest, SaveAndLoad) {
     std::remove(filename);
 }
 
+TEST(FileOperationsTest, SaveMatchesFprintf) {
+    const char* filename = "test_save.txt";
+    const double values[] = {0, -0.0, 100, 0.0000005, 0.0000015, 2.5e-7, 499.9999995, 123.456789123,
+                             -1.25, 1e20, 1e300, 1.0 / 3.0, std::nan(""), -INFINITY};
+    NPC_array arr;
+    for (size_t i = 0; i + 1 < std::size(values); ++i) {
+        arr.add_NPC(std::make_unique<druid>("Друид" + std::to_string(i), values[i], values[i + 1]));
+    }
+    arr.add_NPC(std::make_unique<NPC>("Безымянный", 1, 2));
+
+    std::string expected;
+    for (const auto& npc : arr.get_npcs()) {
+        char line[1024];
+        std::string name(npc->get_name());
+        snprintf(line, sizeof(line), "%s %s %lf %lf\n", npc->get_type().c_str(),
+                 name.c_str(), npc->get_x_cord(), npc->get_y_cord());
+        expected += line;
+    }
+    NPCFactory::save_to_file(filename, arr);
+    std::ifstream file(filename, std::ios::binary);
+    std::string actual((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(actual, expected);
+
+    file.close();
+    std::remove(filename);
+}
+
 TEST(FileOperationsTest, LoadInvalidCoordinates) {
     const char* filename = "test_invalid.txt";
     
@@ -210,6 +453,187 @@ TEST(FileOperationsTest, LoadNonExistentFile) {
                  std::runtime_error);
 }
 
+static std::vector<std::string> dump(const NPC_array& arr) {
+    std::vector<std::string> out;
+    for (const auto& npc : arr.get_npcs()) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), " %.17g %.17g", npc->get_x_cord(), npc->get_y_cord());
+        out.push_back(npc->get_type() + " " + std::string(npc->get_name()) + buf);
+    }
+    return out;
+}
+
+TEST(FileOperationsTest, MmapLoaderMatchesFscanf) {
+    const char* filename = "test_mmap.txt";
+    std::ofstream file(filename);
+    file << "squirrel Белка1 100 100\n";
+    file << "werewolf\tОборотень1   1.5e2  +120.25\r\n";
+    file << "dragon Змей 10 10\n";
+    file << "druid Друид1 600 10\n";
+    file << "\n\n  druid Друид2 0.1 499.999999\n";
+    file << "squirrel Белка2 -0 500\n";
+    file << "druid Друид3 0x1.8p3 +0X10\n";
+    // экспонента без цифр: fscanf берёт мантиссу и пропускает e и знак
+    file << "squirrel Белка3 1e 5\n";
+    file << "druid Друид4 2E- 1.e+\n";
+    file << "squirrel Белка4 0x1p+ 0x1.8P\n";
+    file << "werewolf Оборотень2 -0x0 0x1p-2";
+    file.close();
+
+    NPC_array expected, actual;
+    testing::internal::CaptureStderr();
+    NPCFactory::load_from_file_c_style(filename, expected);
+    std::string expected_err = testing::internal::GetCapturedStderr();
+    testing::internal::CaptureStderr();
+    NPCFactory::load_from_file_mmap(filename, actual);
+    std::string actual_err = testing::internal::GetCapturedStderr();
+
+    ASSERT_EQ(expected.get_size(), 9);
+    ASSERT_EQ(dump(expected), dump(actual));
+    NPC_array parallel;
+    testing::internal::CaptureStderr();
+    NPCFactory::load_from_file_parallel(filename, parallel, 2);
+    testing::internal::GetCapturedStderr();
+    ASSERT_EQ(dump(expected), dump(parallel));
+    ASSERT_EQ(expected_err, actual_err);
+    ASSERT_TRUE(actual_err.find("Line 3") != std::string::npos);
+    ASSERT_TRUE(actual_err.find("Line 4") != std::string::npos);
+
+    std::remove(filename);
+}
+
+TEST(FileOperationsTest, MmapLoaderStopsAtBadNumber) {
+    const char* filename = "test_mmap_bad.txt";
+    std::ofstream file(filename);
+    file << "squirrel Белка1 100 100\n";
+    file << "werewolf Оборотень1 abc 120\n";
+    file << "druid Друид1 200 200\n";
+    file.close();
+
+    NPC_array expected, actual;
+    NPCFactory::load_from_file_c_style(filename, expected);
+    NPCFactory::load_from_file_mmap(filename, actual);
+    ASSERT_EQ(dump(expected), dump(actual));
+    ASSERT_EQ(actual.get_size(), 1);
+
+    std::remove(filename);
+}
+
+TEST(FileOperationsTest, ParallelLoaderMatchesFscanf) {
+    const char* filename = "test_parallel.txt";
+    const char* contents[] = {
+        // обычные записи, ошибки и запись, разорванная переводом строки
+        "squirrel Белка1 100 100\nwerewolf Оборотень1 150\n 120\ndragon Змей 1 1\n"
+        "druid Друид1 600 10\n\n\nsquirrel Белка2 3 4\ndruid Друид2 5 6\n",
+        // некорректное число в середине файла
+        "squirrel Белка1 100 100\nwerewolf Оборотень1 abc 120\ndruid Друид1 200 200\n",
+        // незавершённая запись в конце
+        "squirrel Белка1 100 100\nwerewolf Оборотень1 1",
+        // экспонента без цифр, в том числе на границе блока
+        "squirrel a 1e 5\nwerewolf b 2 3\ndruid Друид1 7E+\n8e-\nsquirrel c 1e",
+        // после e идёт не цифра: fscanf останавливается на ней
+        "squirrel a 1ex 5\nwerewolf b 2 3\n",
+    };
+    for (const char* content : contents) {
+        std::ofstream file(filename);
+        file << content;
+        file.close();
+        for (size_t chunk : {size_t(1), size_t(16), size_t(1 << 20)}) {
+            NPC_array expected, actual;
+            testing::internal::CaptureStderr();
+            NPCFactory::load_from_file_c_style(filename, expected);
+            std::string expected_err = testing::internal::GetCapturedStderr();
+            testing::internal::CaptureStderr();
+            NPCFactory::load_from_file_parallel(filename, actual, 3, chunk);
+            std::string actual_err = testing::internal::GetCapturedStderr();
+            ASSERT_EQ(dump(expected), dump(actual));
+            ASSERT_EQ(expected_err, actual_err);
+        }
+    }
+    std::remove(filename);
+}
+
+TEST(FileOperationsTest, MmapLoaderMissingAndEmptyFile) {
+    NPC_array arr;
+    ASSERT_THROW(NPCFactory::load_from_file_mmap("nonexistent.txt", arr), std::runtime_error);
+    std::ofstream("test_empty.txt").close();
+    NPCFactory::load_from_file_mmap("test_empty.txt", arr);
+    ASSERT_EQ(arr.get_size(), 0);
+    std::remove("test_empty.txt");
+}
+
+TEST(FileOperationsTest, BinarySnapshotRoundTrip) {
+    const char* filename = "test_snapshot.bin";
+    NPC_array arr1;
+    arr1.add_NPC(std::make_unique<squirrel>("Белка1", 100.123456789012345, 0.1));
+    arr1.add_NPC(std::make_unique<werewolf>("Оборотень1", 1.0 / 3.0, 499.99999999999994));
+    arr1.add_NPC(std::make_unique<druid>("Белка1", 0, 500));
+    arr1.add_NPC(std::make_unique<NPC>("", 7, 8));
+    NPCFactory::save_binary(filename, arr1);
+
+    NPC_array arr2;
+    NPCFactory::load_binary(filename, arr2);
+    ASSERT_EQ(arr2.get_size(), arr1.get_size());
+    for (size_t i = 0; i < arr1.get_size(); ++i) {
+        const auto& a = arr1.get_npcs()[i];
+        const auto& b = arr2.get_npcs()[i];
+        ASSERT_EQ(a->get_kind(), b->get_kind());
+        ASSERT_EQ(a->get_type(), b->get_type());
+        ASSERT_EQ(a->get_name(), b->get_name());
+        double coords_a[2] = {a->get_x_cord(), a->get_y_cord()};
+        double coords_b[2] = {b->get_x_cord(), b->get_y_cord()};
+        ASSERT_EQ(std::memcmp(coords_a, coords_b, sizeof(coords_a)), 0);
+    }
+    std::remove(filename);
+}
+
+TEST(FileOperationsTest, BinarySnapshotMapsKindsByName) {
+    const char* filename = "test_snapshot_kinds.bin";
+    KillRules saved = active_rules();
+    active_rules() = KillRules::parse("kind troll\nkind dragon\n");
+    {
+        NPC_array arr;
+        arr.emplace_npc(NPCFactory::kind_of("troll"), "Тролль", 1, 2);
+        arr.emplace_npc(NPCKind::druid, "Друид", 3, 4);
+        NPCFactory::save_binary(filename, arr);
+    }
+    // другой порядок видов в конфиге
+    active_rules() = KillRules::parse("kind dragon\nkind troll\n");
+    NPC_array loaded;
+    NPCFactory::load_binary(filename, loaded);
+    ASSERT_EQ(loaded.get_npcs()[0]->get_type(), "troll");
+    ASSERT_EQ(loaded.get_npcs()[1]->get_type(), "druid");
+    // вида нет в конфиге
+    active_rules() = KillRules::parse("kind dragon\n");
+    NPC_array rejected;
+    ASSERT_THROW(NPCFactory::load_binary(filename, rejected), std::runtime_error);
+    ASSERT_EQ(rejected.get_size(), 0);
+    active_rules() = saved;
+    std::remove(filename);
+}
+
+TEST(FileOperationsTest, BinarySnapshotRejectsGarbage) {
+    const char* filename = "test_snapshot_bad.bin";
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 1, 2));
+    NPCFactory::save_binary(filename, arr);
+    {
+        // обрезанный файл
+        std::ifstream in(filename, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), bytes.size() - 1);
+    }
+    NPC_array loaded;
+    ASSERT_THROW(NPCFactory::load_binary(filename, loaded), std::runtime_error);
+    ASSERT_EQ(loaded.get_size(), 0);
+
+    std::ofstream(filename) << "squirrel Белка1 1 2\n";
+    ASSERT_THROW(NPCFactory::load_binary(filename, loaded), std::runtime_error);
+    std::remove(filename);
+}
+
 // ==================== Тесты Observer ====================
 
 TEST(ObserverTest, FileLoggerCreation) {
@@ -228,6 +652,49 @@ TEST(ObserverTest, FileLoggerCreation) {
     std::remove("test.log");
 }
 
+TEST(ObserverTest, AsyncFileLoggerFlush) {
+    std::remove("async_test.log");
+    AsyncFileLogger logger("async_test.log");
+    logger.update("Первое событие");
+    logger.update("Второе событие");
+    logger.flush();
+
+    std::ifstream file("async_test.log");
+    std::string line;
+    std::getline(file, line);
+    ASSERT_EQ(line, "Первое событие");
+    std::getline(file, line);
+    ASSERT_EQ(line, "Второе событие");
+    ASSERT_EQ(logger.get_dropped(), 0);
+
+    file.close();
+    std::remove("async_test.log");
+}
+
+TEST(ObserverTest, AsyncFileLoggerDropPolicy) {
+    std::remove("async_drop.log");
+    const int total = 10000;
+    uint64_t dropped = 0;
+    {
+        AsyncFileLogger logger("async_drop.log", 4, std::chrono::milliseconds(100), OverflowPolicy::drop);
+        for (int i = 0; i < total; ++i) {
+            logger.update("event " + std::to_string(i));
+        }
+        logger.flush();
+        dropped = logger.get_dropped();
+    }
+    // Каждое событие либо записано, либо учтено как отброшенное
+    std::ifstream file("async_drop.log");
+    int lines = 0;
+    for (std::string line; std::getline(file, line);) {
+        ++lines;
+    }
+    ASSERT_EQ(lines + dropped, total);
+
+    file.close();
+    std::remove("async_drop.log");
+}
+
 TEST(ObserverTest, DisplayOutput) {
     Display display;
     
@@ -238,6 +705,49 @@ TEST(ObserverTest, DisplayOutput) {
     ASSERT_TRUE(output.find("Test message") != std::string::npos);
 }
 
+TEST(ObserverTest, CombatEventTextMatchesLogFormat) {
+    CombatEvent event{"Белка1", "Оборотень1", NPCKind::squirrel, NPCKind::werewolf,
+                      100, 100, 110, 110, 1};
+    ASSERT_EQ(format_event(event), "NPC werewolf Оборотень1 убит. Убийца: squirrel Белка1.");
+
+    testing::internal::CaptureStdout();
+    Display display;
+    Observer& observer = display;
+    observer.update(event);
+    ASSERT_EQ(testing::internal::GetCapturedStdout(), format_event(event) + "\n");
+}
+
+class EventCollector: public Observer {
+    public:
+        void update(const std::string& event) override {
+            text_calls++;
+        }
+        void update(const CombatEvent& event) override {
+            events.push_back(event);
+        }
+        std::vector<CombatEvent> events;
+        int text_calls = 0;
+};
+
+TEST(ObserverTest, StructuredEventsSkipFormatting) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 100, 100));
+    arr.add_NPC(std::make_unique<werewolf>("Оборотень1", 110, 120));
+
+    auto collector = std::make_unique<EventCollector>();
+    EventCollector* raw = collector.get();
+    CombatVisitor combat;
+    combat.add_observer(std::move(collector));
+    combat.do_combat(arr, 50.0);
+
+    ASSERT_EQ(raw->text_calls, 0);
+    ASSERT_EQ(raw->events.size(), 1);
+    ASSERT_EQ(raw->events[0].victim_kind, NPCKind::werewolf);
+    ASSERT_EQ(raw->events[0].attacker_kind, NPCKind::squirrel);
+    ASSERT_EQ(raw->events[0].victim_y, 120);
+    ASSERT_EQ(raw->events[0].round, 1);
+}
+
 // ==================== Тесты CombatVisitor ====================
 
 TEST(CombatTest, SquirrelKillsWerewolf) {
@@ -297,6 +807,20 @@ TEST(CombatTest, DruidDoesNotAttack) {
     ASSERT_EQ(arr.get_size(), 1);
 }
 
+TEST(CombatTest, NamesakeSurvives) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 100, 100));
+    arr.add_NPC(std::make_unique<werewolf>("Тёзка", 110, 110));
+    arr.add_NPC(std::make_unique<werewolf>("Тёзка", 400, 400));
+
+    CombatVisitor combat;
+    combat.do_combat(arr, 50.0);
+
+    // Погибает только оборотень рядом с белкой, а не все с тем же именем
+    ASSERT_EQ(arr.get_size(), 2);
+    ASSERT_EQ(arr.get_npcs()[1]->get_x_cord(), 400);
+}
+
 TEST(CombatTest, OutOfRange) {
     NPC_array arr;
     arr.add_NPC(std::make_unique<squirrel>("Белка1", 100, 100));
@@ -367,6 +891,1019 @@ TEST(CombatTest, WithObservers) {
     std::remove("combat_test.log");
 }
 
+// ==================== Тесты колоночного хранилища ====================
+
+TEST(ColumnsTest, MirrorsArray) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 100, 200));
+    arr.add_NPC(std::make_unique<werewolf>("Оборотень1", 150, 250));
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 300, 400));
+    arr.get_npcs()[1]->kill_npc();
+
+    NPC_columns columns;
+    columns.assign(arr);
+
+    ASSERT_EQ(columns.size(), 3);
+    ASSERT_EQ(columns.x[2], 300);
+    ASSERT_EQ(columns.y[1], 250);
+    ASSERT_EQ(columns.kind[0], NPCKind::squirrel);
+    ASSERT_EQ(columns.kind[1], NPCKind::werewolf);
+    ASSERT_TRUE(columns.is_alive(0));
+    ASSERT_FALSE(columns.is_alive(1));
+    // одинаковые имена получают один идентификатор
+    ASSERT_EQ(columns.name_id[0], columns.name_id[2]);
+    ASSERT_EQ(arr.get_names().get(columns.name_id[1]), "Оборотень1");
+}
+
+// ==================== Тесты пространственной сетки ====================
+
+class EventRecorder: public Observer {
+    public:
+        EventRecorder(std::vector<std::string>& out) : events(out) {}
+        void update(const std::string& event) override {
+            events.push_back(event);
+        }
+    private:
+        std::vector<std::string>& events;
+};
+
+static void fill_random_world(NPC_array& arr, size_t count, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    const char* types[] = {"squirrel", "werewolf", "druid"};
+    for (size_t i = 0; i < count; ++i) {
+        arr.add_NPC(NPCFactory::create_npc(types[gen() % 3], "npc" + std::to_string(i),
+                                           coord(gen), coord(gen)));
+    }
+}
+
+static std::vector<std::string> survivors(const NPC_array& arr) {
+    std::vector<std::string> names;
+    for (const auto& npc : arr.get_npcs()) {
+        names.emplace_back(npc->get_name());
+    }
+    return names;
+}
+
+// Считает вызовы visit_* и бьёт как обычный CombatVisitor
+class CountingVisitor: public CombatVisitor {
+    public:
+        explicit CountingVisitor(size_t threads = 1) : CombatVisitor(threads) {}
+        void visit_squirrel(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc) override {
+            ++squirrels;
+            CombatVisitor::visit_squirrel(to_delete, npc, to_npc);
+        }
+        void visit_werewolf(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc) override {
+            ++werewolves;
+            CombatVisitor::visit_werewolf(to_delete, npc, to_npc);
+        }
+        void visit_druid(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc) override {
+            ++druids;
+            CombatVisitor::visit_druid(to_delete, npc, to_npc);
+        }
+        int squirrels = 0;
+        int werewolves = 0;
+        int druids = 0;
+};
+
+TEST(CombatVisitorTest, SubclassesSeeEveryPairInRange) {
+    for (size_t threads : {1, 3}) {
+        for (bool use_grid : {true, false}) {
+            NPC_array arr;
+            arr.emplace_npc(NPCKind::druid, "Друид1", 10, 10);
+            arr.emplace_npc(NPCKind::druid, "Друид2", 12, 10);
+            arr.emplace_npc(NPCKind::werewolf, "Оборотень", 100, 100);
+            arr.emplace_npc(NPCKind::squirrel, "Белка", 101, 100);
+            CountingVisitor visitor(threads);
+            visitor.set_use_grid(use_grid);
+            visitor.do_combat(arr, 5.0);
+            // друиды никого не убивают, оборотень не убивает белку
+            ASSERT_EQ(visitor.druids, 2);
+            ASSERT_EQ(visitor.werewolves, 1);
+            ASSERT_EQ(visitor.squirrels, 1);
+            ASSERT_EQ(survivors(arr), (std::vector<std::string>{"Друид1", "Друид2", "Белка"}));
+        }
+    }
+}
+
+TEST(CombatVisitorTest, ReportsLastRoundVictims) {
+    NPC_array arr;
+    arr.emplace_npc(NPCKind::werewolf, "Оборотень", 10, 10);
+    arr.emplace_npc(NPCKind::druid, "Друид", 12, 10);
+    arr.emplace_npc(NPCKind::squirrel, "Белка", 100, 100);
+    CombatVisitor visitor;
+    visitor.do_combat(arr, 5.0);
+    ASSERT_EQ(visitor.get_victims().size(), 1u);
+    ASSERT_EQ(arr.get_names().get(visitor.get_victims()[0]), "Друид");
+    // следующий раунд без жертв очищает список
+    visitor.do_combat(arr, 5.0);
+    ASSERT_TRUE(visitor.get_victims().empty());
+}
+
+TEST(GridTest, MatchesBruteForce) {
+    for (double rad : {3.0, 10.0, 25.0}) {
+        NPC_array brute_arr, grid_arr;
+        fill_random_world(brute_arr, 2000, 42);
+        fill_random_world(grid_arr, 2000, 42);
+        std::vector<std::string> brute_events, grid_events;
+
+        CombatVisitor brute;
+        brute.set_use_grid(false);
+        brute.add_observer(std::make_unique<EventRecorder>(brute_events));
+        brute.do_combat(brute_arr, rad);
+
+        CombatVisitor grid;
+        grid.add_observer(std::make_unique<EventRecorder>(grid_events));
+        grid.do_combat(grid_arr, rad);
+
+        ASSERT_FALSE(brute_events.empty());
+        ASSERT_EQ(brute_events, grid_events);
+        ASSERT_EQ(survivors(brute_arr), survivors(grid_arr));
+    }
+}
+
+TEST(ParallelCombatTest, MatchesSerial) {
+    for (bool use_grid : {true, false}) {
+        NPC_array serial_arr, parallel_arr;
+        fill_random_world(serial_arr, 3000, 7);
+        fill_random_world(parallel_arr, 3000, 7);
+        std::vector<std::string> serial_events, parallel_events;
+
+        CombatVisitor serial;
+        serial.set_use_grid(use_grid);
+        serial.add_observer(std::make_unique<EventRecorder>(serial_events));
+        serial.do_combat(serial_arr, 8.0);
+
+        CombatVisitor parallel(4);
+        parallel.set_use_grid(use_grid);
+        parallel.add_observer(std::make_unique<EventRecorder>(parallel_events));
+        parallel.do_combat(parallel_arr, 8.0);
+
+        ASSERT_EQ(parallel.get_threads(), 4);
+        ASSERT_FALSE(serial_events.empty());
+        ASSERT_EQ(serial_events, parallel_events);
+        ASSERT_EQ(survivors(serial_arr), survivors(parallel_arr));
+    }
+}
+
+TEST(IncrementalCombatTest, MatchesFullRounds) {
+    for (bool use_grid : {true, false}) {
+        NPC_array full_arr, inc_arr;
+        fill_random_world(full_arr, 2000, 11);
+        fill_random_world(inc_arr, 2000, 11);
+        std::vector<std::string> full_events, inc_events;
+
+        CombatVisitor full;
+        full.set_use_grid(use_grid);
+        full.add_observer(std::make_unique<EventRecorder>(full_events));
+        CombatVisitor inc;
+        inc.set_use_grid(use_grid);
+        inc.set_incremental(true);
+        inc.add_observer(std::make_unique<EventRecorder>(inc_events));
+
+        std::mt19937 gen(5);
+        std::uniform_real_distribution<double> coord(0.0, 500.0);
+        for (int tick = 0; tick < 10; ++tick) {
+            // каждый тик часть NPC сдвигается и появляются новые
+            size_t n = full_arr.get_size();
+            for (int k = 0; k < 20; ++k) {
+                size_t i = gen() % n;
+                double x = coord(gen), y = coord(gen);
+                full_arr.get_npcs()[i]->set_x(x);
+                inc_arr.get_npcs()[i]->set_x(x);
+                full_arr.get_npcs()[i]->set_y(y);
+                inc_arr.get_npcs()[i]->set_y(y);
+            }
+            std::string name = "new" + std::to_string(tick);
+            double x = coord(gen), y = coord(gen);
+            full_arr.add_NPC(std::make_unique<squirrel>(name, x, y));
+            inc_arr.add_NPC(std::make_unique<squirrel>(name, x, y));
+
+            full.do_combat(full_arr, 8.0);
+            inc.do_combat(inc_arr, 8.0);
+            ASSERT_EQ(full_events, inc_events);
+            ASSERT_EQ(survivors(full_arr), survivors(inc_arr));
+        }
+        ASSERT_FALSE(full_events.empty());
+
+        // без движения новых убийств нет
+        size_t before = inc_events.size();
+        inc.do_combat(inc_arr, 8.0);
+        ASSERT_EQ(inc_events.size(), before);
+        ASSERT_EQ(inc_arr.get_settled_radius(), 8.0);
+    }
+}
+
+// Друид убивает всех в радиусе, в обход правил
+class DruidRampage: public CombatVisitor {
+    public:
+        void visit_druid(std::vector<uint32_t>& to_delete, NPC_ptr& npc, NPC_ptr& to_npc) override {
+            to_npc->kill_npc();
+            to_delete.push_back(to_npc->get_name_id());
+        }
+};
+
+TEST(IncrementalCombatTest, SubclassAfterPlainVisitorRunsFullRound) {
+    NPC_array arr;
+    arr.emplace_npc(NPCKind::druid, "Друид1", 10, 10);
+    arr.emplace_npc(NPCKind::druid, "Друид2", 12, 10);
+    CombatVisitor plain;
+    plain.set_incremental(true);
+    plain.do_combat(arr, 5.0);
+    ASSERT_EQ(arr.get_size(), 2);
+    ASSERT_EQ(arr.get_settled_radius(), 5.0);
+
+    // массив устоялся по правилам, но не для подкласса
+    DruidRampage rampage;
+    rampage.set_incremental(true);
+    rampage.do_combat(arr, 5.0);
+    ASSERT_EQ(survivors(arr), (std::vector<std::string>{"Друид1"}));
+    ASSERT_TRUE(std::isnan(arr.get_settled_radius()));
+}
+
+TEST(VariantCombatTest, MatchesVirtualDispatch) {
+    for (bool use_grid : {true, false}) {
+        NPC_array arr;
+        fill_random_world(arr, 2000, 13);
+        std::vector<NPCVariant> values = to_variants(arr);
+        std::vector<std::string> virtual_events, variant_events;
+
+        CombatVisitor combat;
+        combat.set_use_grid(use_grid);
+        combat.add_observer(std::make_unique<EventRecorder>(virtual_events));
+        VariantCombatVisitor variant;
+        variant.set_use_grid(use_grid);
+        variant.add_observer(std::make_unique<EventRecorder>(variant_events));
+        for (int round = 0; round < 2; ++round) {
+            combat.do_combat(arr, 10.0);
+            variant.do_combat(values, 10.0);
+        }
+
+        ASSERT_FALSE(virtual_events.empty());
+        ASSERT_EQ(virtual_events, variant_events);
+        std::vector<std::string> names;
+        for (const auto& v : values) {
+            names.emplace_back(as_npc(v).get_name());
+        }
+        ASSERT_EQ(survivors(arr), names);
+    }
+}
+
+TEST(VariantCombatTest, KillRulesAtCompileTime) {
+    static_assert(kills_v<squirrel, werewolf>);
+    static_assert(kills_v<werewolf, druid>);
+    static_assert(!kills_v<druid, squirrel>);
+    ASSERT_THROW(make_variant(NPC("Безымянный", 1, 2)), std::logic_error);
+    NPCVariant v = make_variant(druid("Друид1", 1, 2));
+    ASSERT_TRUE(std::holds_alternative<druid>(v));
+    ASSERT_EQ(as_npc(v).get_name(), "Друид1");
+}
+
+TEST(GridTest, PairOnCellBoundary) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 0, 0));
+    arr.add_NPC(std::make_unique<werewolf>("Оборотень1", 10, 0));
+    arr.add_NPC(std::make_unique<druid>("Друид1", 500, 500));
+
+    CombatVisitor combat;
+    combat.do_combat(arr, 10.0);
+
+    // Ровно на границе радиуса оборотень погибает
+    ASSERT_EQ(arr.get_size(), 2);
+}
+
+// ==================== Тесты потоковой обработки ====================
+
+// Случайный мир, записанный в файл по тайлам
+static void write_tiled_world(const char* filename, size_t count, double tile, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    const char* types[] = {"squirrel", "werewolf", "druid"};
+    struct Record {
+        int64_t row, col;
+        const char* type;
+        double x, y;
+    };
+    std::vector<Record> records;
+    char text[64];
+    for (size_t i = 0; i < count; ++i) {
+        const char* type = types[gen() % 3];
+        snprintf(text, sizeof(text), "%f", coord(gen));
+        double x = std::strtod(text, nullptr);
+        snprintf(text, sizeof(text), "%f", coord(gen));
+        double y = std::strtod(text, nullptr);
+        records.push_back({tile_row(y, tile), tile_col(x, tile), type, x, y});
+    }
+    std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+    FILE* file = fopen(filename, "w");
+    for (size_t i = 0; i < records.size(); ++i) {
+        fprintf(file, "%s npc%zu %f %f\n", records[i].type, i % 700, records[i].x, records[i].y);
+    }
+    fclose(file);
+}
+
+static std::string read_file(const char* filename) {
+    std::ifstream in(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+TEST(StreamingCombatTest, MatchesInMemoryRound) {
+    for (double rad : {4.0, 10.0}) {
+        write_tiled_world("stream_in.txt", 5000, 10.0, 21);
+
+        NPC_array arr;
+        NPCFactory::load_from_file_c_style("stream_in.txt", arr);
+        std::vector<std::string> memory_events;
+        CombatVisitor memory;
+        memory.add_observer(std::make_unique<EventRecorder>(memory_events));
+        memory.do_combat(arr, rad);
+        NPCFactory::save_to_file("stream_expected.txt", arr);
+
+        std::vector<std::string> stream_events;
+        CombatVisitor visitor;
+        visitor.add_observer(std::make_unique<EventRecorder>(stream_events));
+        StreamingCombat streaming(visitor, 10.0);
+        StreamStats stats = streaming.run("stream_in.txt", "stream_out.txt", rad);
+
+        ASSERT_EQ(stream_events, memory_events);
+        ASSERT_EQ(read_file("stream_out.txt"), read_file("stream_expected.txt"));
+        ASSERT_EQ(stats.loaded, 5000);
+        ASSERT_EQ(stats.written, arr.get_size());
+        // В памяти держится не больше трёх рядов тайлов
+        ASSERT_LT(stats.peak_resident, 5000 / 10);
+    }
+    std::remove("stream_in.txt");
+    std::remove("stream_expected.txt");
+    std::remove("stream_out.txt");
+}
+
+TEST(StreamingCombatTest, RejectsUnsortedFile) {
+    FILE* file = fopen("stream_unsorted.txt", "w");
+    fprintf(file, "squirrel a 1 300\nwerewolf b 2 1\n");
+    fclose(file);
+    CombatVisitor visitor;
+    StreamingCombat streaming(visitor, 10.0);
+    ASSERT_THROW(streaming.run("stream_unsorted.txt", "stream_out.txt", 5.0), std::runtime_error);
+    ASSERT_THROW(streaming.run("stream_unsorted.txt", "stream_out.txt", 20.0), std::logic_error);
+    // радиус сравнивается по модулю, в том числе радиусы видов
+    ASSERT_THROW(streaming.run("stream_unsorted.txt", "stream_out.txt", -20.0), std::logic_error);
+    visitor.set_kind_radius(NPCKind::werewolf, -15.0);
+    ASSERT_EQ(visitor.reach(5.0), 15.0);
+    ASSERT_THROW(streaming.run("stream_unsorted.txt", "stream_out.txt", 5.0), std::logic_error);
+    std::remove("stream_unsorted.txt");
+    std::remove("stream_out.txt");
+}
+
+// ==================== Тесты шины событий ====================
+
+// Запоминает раунд и размер каждого пакета, по желанию медленно
+class BatchRecorder: public Observer {
+    public:
+        BatchRecorder(std::vector<std::pair<size_t, size_t>>& out, int delay_ms = 0)
+            : batches(out), delay(delay_ms) {}
+        void update(const std::string& event) override {}
+        void update_batch(const EventBatch& batch) override {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+            batches.emplace_back(batch.round, batch.events.size());
+        }
+    private:
+        std::vector<std::pair<size_t, size_t>>& batches;
+        int delay;
+};
+
+TEST(EventBusTest, MatchesSynchronousDelivery) {
+    std::vector<std::string> sync_events;
+    {
+        NPC_array arr;
+        fill_random_world(arr, 2000, 31);
+        CombatVisitor combat;
+        combat.add_observer(std::make_unique<EventRecorder>(sync_events));
+        combat.do_combat(arr, 5.0);
+        combat.do_combat(arr, 10.0);
+    }
+    std::vector<std::string> bus_events;
+    std::vector<std::pair<size_t, size_t>> batches;
+    CombatVisitor combat;
+    combat.add_observer(std::make_unique<EventRecorder>(bus_events));
+    combat.set_event_bus(true);
+    combat.add_observer(std::make_unique<BatchRecorder>(batches, 5));
+    {
+        NPC_array arr;
+        fill_random_world(arr, 2000, 31);
+        combat.do_combat(arr, 5.0);
+        combat.do_combat(arr, 10.0);
+    }
+    // Массив уже уничтожен: пакеты хранят свои копии имён
+    combat.flush_observers();
+
+    ASSERT_EQ(bus_events, sync_events);
+    ASSERT_EQ(batches.size(), 2);
+    ASSERT_EQ(batches[0].first, 1);
+    ASSERT_EQ(batches[1].first, 2);
+    ASSERT_EQ(batches[0].second + batches[1].second, sync_events.size());
+}
+
+TEST(EventBusTest, SlowObserverDoesNotBlockCombat) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 100, 100));
+    arr.add_NPC(std::make_unique<werewolf>("Оборотень1", 110, 110));
+    std::vector<std::pair<size_t, size_t>> batches;
+    CombatVisitor combat;
+    combat.set_event_bus(true);
+    combat.add_observer(std::make_unique<BatchRecorder>(batches, 500));
+
+    auto start = std::chrono::steady_clock::now();
+    combat.do_combat(arr, 50.0);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_LT(elapsed, std::chrono::milliseconds(250));
+
+    combat.flush_observers();
+    ASSERT_EQ(batches.size(), 1);
+    ASSERT_EQ(batches[0].second, 1);
+}
+
+TEST(EventBusTest, TurningOffMakesObserversSynchronous) {
+    std::vector<std::string> events;
+    CombatVisitor combat;
+    combat.set_event_bus(true);
+    combat.add_observer(std::make_unique<EventRecorder>(events));
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка1", 100, 100));
+    arr.add_NPC(std::make_unique<werewolf>("Оборотень1", 110, 110));
+    arr.add_NPC(std::make_unique<druid>("Друид1", 300, 300));
+    combat.do_combat(arr, 50.0);
+    combat.set_event_bus(false);
+    ASSERT_EQ(events.size(), 1);
+
+    arr.add_NPC(std::make_unique<werewolf>("Оборотень2", 300, 310));
+    combat.do_combat(arr, 50.0);
+    ASSERT_FALSE(combat.has_event_bus());
+    ASSERT_EQ(events.size(), 2);
+}
+
+// ==================== Тесты таблицы правил ====================
+
+// Подменяет активные правила на время теста
+class RulesGuard {
+    public:
+        explicit RulesGuard(const KillRules& rules) : saved(active_rules()) { active_rules() = rules; }
+        ~RulesGuard() { active_rules() = saved; }
+    private:
+        KillRules saved;
+};
+
+TEST(RulesTest, DefaultConfigIsKillMatrix) {
+    KillRules rules;
+    KillRules parsed = KillRules::parse("squirrel kills werewolf druid\nwerewolf kills druid\n");
+    ASSERT_EQ(rules.size(), NPC_KIND_COUNT);
+    for (size_t a = 0; a < NPC_KIND_COUNT; ++a) {
+        for (size_t t = 0; t < NPC_KIND_COUNT; ++t) {
+            ASSERT_EQ(rules.kills(a, t), KILL_MATRIX[a][t]);
+            ASSERT_EQ(parsed.kills(a, t), KILL_MATRIX[a][t]);
+        }
+    }
+}
+
+TEST(RulesTest, ParsesKindsAndRules) {
+    KillRules rules = KillRules::parse(
+        "# драконы\n"
+        "kind dragon\n"
+        "\n"
+        "dragon kills squirrel werewolf  # и оборотней\n"
+        "druid kills dragon\n");
+    size_t dragon = rules.find("dragon");
+    ASSERT_EQ(dragon, NPC_KIND_COUNT);
+    ASSERT_TRUE(rules.kills(dragon, static_cast<size_t>(NPCKind::squirrel)));
+    ASSERT_TRUE(rules.kills(static_cast<size_t>(NPCKind::druid), dragon));
+    // Конфиг заменяет правила по умолчанию
+    ASSERT_FALSE(rules.kills(static_cast<size_t>(NPCKind::squirrel), static_cast<size_t>(NPCKind::werewolf)));
+
+    ASSERT_THROW(KillRules::parse("troll kills druid\n"), std::runtime_error);
+    ASSERT_THROW(KillRules::parse("squirrel eats druid\n"), std::runtime_error);
+    ASSERT_THROW(KillRules::parse("kind\n"), std::runtime_error);
+}
+
+TEST(RulesTest, ConfigKindsLoadFightAndSave) {
+    RulesGuard guard(KillRules::parse("kind dragon\ndragon kills squirrel\nsquirrel kills werewolf\n"));
+    FILE* file = fopen("rules_world.txt", "w");
+    fprintf(file, "dragon Смауг 100 100\nsquirrel Белка1 105 100\nwerewolf Оборотень1 300 300\n");
+    fclose(file);
+    NPC_array arr;
+    NPCFactory::load_from_file_c_style("rules_world.txt", arr);
+    ASSERT_EQ(arr.get_size(), 3);
+    ASSERT_EQ(arr.get_npcs()[0]->get_type(), "dragon");
+
+    std::vector<std::string> events;
+    CombatVisitor combat;
+    combat.add_observer(std::make_unique<EventRecorder>(events));
+    combat.do_combat(arr, 10.0);
+    ASSERT_EQ(survivors(arr), (std::vector<std::string>{"Смауг", "Оборотень1"}));
+    ASSERT_EQ(events, (std::vector<std::string>{"NPC squirrel Белка1 убит. Убийца: dragon Смауг."}));
+
+    NPCFactory::save_to_file("rules_world.txt", arr);
+    std::ifstream saved("rules_world.txt");
+    std::string line;
+    std::getline(saved, line);
+    ASSERT_EQ(line, "dragon Смауг 100.000000 100.000000");
+    saved.close();
+    std::remove("rules_world.txt");
+}
+
+TEST(RulesTest, NewRulesUnsettleTheWorld) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<druid>("Друид1", 100, 100));
+    arr.add_NPC(std::make_unique<druid>("Друид2", 105, 100));
+    CombatVisitor combat;
+    combat.set_incremental(true);
+    combat.do_combat(arr, 10.0);
+    combat.do_combat(arr, 10.0);
+    ASSERT_EQ(arr.get_size(), 2);
+
+    // Никто не двигался, но теперь друиды убивают друг друга
+    RulesGuard guard(KillRules::parse("druid kills druid\n"));
+    combat.do_combat(arr, 10.0);
+    ASSERT_EQ(survivors(arr), (std::vector<std::string>{"Друид1"}));
+}
+
+TEST(RulesTest, ManyKindsMatchAcrossPaths) {
+    std::mt19937 gen(17);
+    std::string config;
+    for (int k = 0; k < 40; ++k) {
+        config += "kind k" + std::to_string(k) + "\n";
+    }
+    for (int a = 0; a < 40; ++a) {
+        config += "k" + std::to_string(a) + " kills";
+        for (int t = 0; t < 40; ++t) {
+            if (gen() % 4 == 0) {
+                config += " k" + std::to_string(t);
+            }
+        }
+        config += "\n";
+    }
+    RulesGuard guard(KillRules::parse(config));
+    auto make = [](NPC_array& arr) {
+        std::mt19937 gen(5);
+        std::uniform_real_distribution<double> coord(0.0, 500.0);
+        for (int i = 0; i < 3000; ++i) {
+            NPCKind kind = NPCFactory::kind_of("k" + std::to_string(gen() % 40));
+            arr.emplace_npc(kind, "npc" + std::to_string(i), coord(gen), coord(gen));
+        }
+    };
+    NPC_array serial_arr, parallel_arr, brute_arr;
+    make(serial_arr);
+    make(parallel_arr);
+    make(brute_arr);
+    CombatVisitor serial;
+    CombatVisitor parallel(3);
+    CombatVisitor brute;
+    brute.set_use_grid(false);
+    serial.do_combat(serial_arr, 12.0);
+    parallel.do_combat(parallel_arr, 12.0);
+    brute.do_combat(brute_arr, 12.0);
+    ASSERT_LT(serial_arr.get_size(), 3000);
+    ASSERT_EQ(survivors(parallel_arr), survivors(serial_arr));
+    ASSERT_EQ(survivors(brute_arr), survivors(serial_arr));
+}
+
+// ==================== Тесты k-d дерева ====================
+
+// Половина точек в плотных скоплениях, половина равномерно
+static void fill_points(std::vector<double>& xs, std::vector<double>& ys, size_t count, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    std::normal_distribution<double> spread(0.0, 2.0);
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 2) {
+            xs.push_back(coord(gen));
+            ys.push_back(coord(gen));
+        }
+        else {
+            double cx = 100.0 * static_cast<double>(gen() % 5);
+            xs.push_back(cx + spread(gen));
+            ys.push_back(cx + spread(gen));
+        }
+    }
+    // совпадающие точки
+    xs.push_back(xs[0]);
+    ys.push_back(ys[0]);
+}
+
+TEST(KdTreeTest, RadiusQueryMatchesBruteForce) {
+    std::vector<double> xs, ys;
+    fill_points(xs, ys, 5000, 3);
+    KdTree tree;
+    ASSERT_TRUE(tree.build(xs.data(), ys.data(), xs.size()));
+    std::mt19937 gen(4);
+    std::uniform_real_distribution<double> coord(-10.0, 510.0);
+    for (int q = 0; q < 200; ++q) {
+        double x = q % 4 ? coord(gen) : xs[q];
+        double y = q % 4 ? coord(gen) : ys[q];
+        double rad = q % 3 == 0 ? 0.0 : 0.5 * (q % 40);
+        std::vector<uint32_t> expected, found;
+        for (size_t i = 0; i < xs.size(); ++i) {
+            double dx = x - xs[i];
+            double dy = y - ys[i];
+            if (dx * dx + dy * dy <= rad * rad) {
+                expected.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        tree.for_each_in_radius(x, y, rad, [&](uint32_t i) { found.push_back(i); });
+        std::sort(found.begin(), found.end());
+        ASSERT_EQ(found, expected);
+    }
+}
+
+TEST(KdTreeTest, NearestMatchesBruteForce) {
+    std::vector<double> xs, ys;
+    fill_points(xs, ys, 3000, 5);
+    KdTree tree;
+    ASSERT_TRUE(tree.build(xs.data(), ys.data(), xs.size()));
+    std::mt19937 gen(6);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    std::vector<uint32_t> found;
+    for (size_t k : {1, 7, 40}) {
+        for (int q = 0; q < 50; ++q) {
+            double x = q % 2 ? coord(gen) : xs[q];
+            double y = q % 2 ? coord(gen) : ys[q];
+            std::vector<std::pair<double, uint32_t>> all;
+            for (size_t i = 0; i < xs.size(); ++i) {
+                double dx = x - xs[i];
+                double dy = y - ys[i];
+                all.emplace_back(dx * dx + dy * dy, static_cast<uint32_t>(i));
+            }
+            std::sort(all.begin(), all.end());
+            std::vector<uint32_t> expected;
+            for (size_t i = 0; i < k; ++i) {
+                expected.push_back(all[i].second);
+            }
+            tree.nearest(x, y, k, found);
+            ASSERT_EQ(found, expected);
+        }
+    }
+    tree.nearest(0, 0, 10000, found);
+    ASSERT_EQ(found.size(), xs.size());
+}
+
+TEST(KdTreeTest, RejectsEmptyAndNonFinite) {
+    KdTree tree;
+    ASSERT_FALSE(tree.build(nullptr, nullptr, 0));
+    double xs[] = {1.0, NAN};
+    double ys[] = {1.0, 2.0};
+    ASSERT_FALSE(tree.build(xs, ys, 2));
+}
+
+TEST(KdTreeTest, KindRadiiDecideReach) {
+    NPC_array arr;
+    arr.add_NPC(NPCFactory::create_npc("werewolf", "Волк", 100, 100));
+    arr.add_NPC(NPCFactory::create_npc("druid", "Друид", 120, 100));
+    arr.add_NPC(NPCFactory::create_npc("squirrel", "Белка", 100, 130));
+    CombatVisitor visitor;
+    visitor.set_kind_radius(NPCKind::werewolf, 25.0);
+    visitor.set_kind_radius(NPCKind::squirrel, 5.0);
+    ASSERT_EQ(visitor.reach(10.0), 25.0);
+    // оборотень достаёт друида за 20, белка оборотня за 30 — нет
+    visitor.do_combat(arr, 10.0);
+    ASSERT_EQ(survivors(arr), (std::vector<std::string>{"Волк", "Белка"}));
+    visitor.clear_kind_radii();
+    ASSERT_EQ(visitor.reach(10.0), 10.0);
+    visitor.do_combat(arr, 40.0);
+    ASSERT_EQ(survivors(arr), (std::vector<std::string>{"Белка"}));
+}
+
+TEST(KdTreeTest, MixedRadiiMatchBruteForce) {
+    auto run = [](CombatVisitor& visitor, std::vector<std::string>& events) {
+        NPC_array arr;
+        fill_random_world(arr, 3000, 17);
+        visitor.set_kind_radius(NPCKind::squirrel, 3.0);
+        visitor.set_kind_radius(NPCKind::werewolf, 14.0);
+        visitor.set_incremental(true);
+        visitor.add_observer(std::make_unique<EventRecorder>(events));
+        visitor.do_combat(arr, 8.0);
+        visitor.do_combat(arr, 8.0);
+        return survivors(arr);
+    };
+    std::vector<std::string> brute_events, tree_events, parallel_events;
+    CombatVisitor brute;
+    brute.set_use_grid(false);
+    CombatVisitor tree;
+    CombatVisitor parallel(3);
+    auto expected = run(brute, brute_events);
+    ASSERT_EQ(run(tree, tree_events), expected);
+    ASSERT_EQ(run(parallel, parallel_events), expected);
+    ASSERT_FALSE(brute_events.empty());
+    ASSERT_EQ(tree_events, brute_events);
+    ASSERT_EQ(parallel_events, brute_events);
+
+    // одинаковый радиус через дерево совпадает с сеткой
+    NPC_array grid_arr, tree_arr;
+    fill_random_world(grid_arr, 3000, 19);
+    fill_random_world(tree_arr, 3000, 19);
+    CombatVisitor grid;
+    CombatVisitor forced;
+    forced.set_use_tree(true);
+    grid.do_combat(grid_arr, 9.0);
+    forced.do_combat(tree_arr, 9.0);
+    ASSERT_EQ(survivors(tree_arr), survivors(grid_arr));
+}
+
+// ==================== Тесты снимков мира ====================
+
+TEST(WorldSnapshotTest, RestoreUndoesCombatRounds) {
+    NPC_array arr, fresh;
+    fill_random_world(arr, 10000, 23);
+    fill_random_world(fresh, 10000, 23);
+    auto original = dump(arr);
+    WorldSnapshot snap = arr.snapshot();
+    ASSERT_EQ(snap.size(), 10000);
+    // несколько пробных боёв с разными радиусами от одного снимка
+    for (double rad : {2.0, 6.0, 15.0}) {
+        CombatVisitor combat, reference;
+        combat.do_combat(arr, rad);
+        NPC_array copy;
+        fill_random_world(copy, 10000, 23);
+        reference.do_combat(copy, rad);
+        ASSERT_LT(arr.get_size(), 10000);
+        ASSERT_EQ(dump(arr), dump(copy));
+        arr.restore(snap);
+        ASSERT_EQ(dump(arr), original);
+    }
+    CombatVisitor combat, reference;
+    combat.do_combat(arr, 5.0);
+    reference.do_combat(fresh, 5.0);
+    ASSERT_EQ(dump(arr), dump(fresh));
+}
+
+TEST(WorldSnapshotTest, UnchangedChunksAreShared) {
+    NPC_array arr;
+    fill_random_world(arr, 3 * WorldSnapshot::CHUNK_SIZE, 29);
+    WorldSnapshot first = arr.snapshot();
+    WorldSnapshot second = arr.snapshot();
+    ASSERT_EQ(first.get_chunks().size(), 3);
+    ASSERT_EQ(second.get_chunks(), first.get_chunks());
+
+    arr.get_npcs()[WorldSnapshot::CHUNK_SIZE + 5]->set_x(1.5);
+    arr.emplace_npc(NPCKind::druid, "Новый", 10, 10);
+    WorldSnapshot third = arr.snapshot();
+    ASSERT_EQ(third.get_chunks().size(), 4);
+    ASSERT_EQ(third.get_chunks()[0], first.get_chunks()[0]);
+    ASSERT_NE(third.get_chunks()[1], first.get_chunks()[1]);
+    ASSERT_EQ(third.get_chunks()[2], first.get_chunks()[2]);
+
+    // снимок после восстановления снова делит куски
+    arr.restore(first);
+    ASSERT_EQ(arr.get_size(), 3 * WorldSnapshot::CHUNK_SIZE);
+    ASSERT_EQ(arr.snapshot().get_chunks(), first.get_chunks());
+}
+
+TEST(WorldSnapshotTest, RestoresAnySnapshotInAnyOrder) {
+    NPC_array arr;
+    fill_random_world(arr, 5000, 31);
+    arr.set_indexed(true);
+    auto state1 = dump(arr);
+    WorldSnapshot s1 = arr.snapshot();
+    arr.remove_npc("npc10");
+    arr.get_npcs()[100]->kill_npc();
+    arr.erase_dead();
+    arr.get_npcs()[200]->set_name("Переименован");
+    arr.emplace_npc(NPCKind::squirrel, "Белка", 1, 2);
+    auto state2 = dump(arr);
+    WorldSnapshot s2 = arr.snapshot();
+    CombatVisitor combat;
+    combat.do_combat(arr, 10.0);
+    arr.restore(s1);
+    ASSERT_EQ(dump(arr), state1);
+    arr.restore(s2);
+    ASSERT_EQ(dump(arr), state2);
+    arr.remove_npc("Белка");
+    ASSERT_EQ(arr.get_size(), state2.size() - 1);
+    arr.restore(s1);
+    ASSERT_EQ(dump(arr), state1);
+    arr.remove_at(arr.get_npcs()[0]->get_x_cord(), arr.get_npcs()[0]->get_y_cord());
+    ASSERT_EQ(arr.get_size(), state1.size() - 1);
+}
+
+// Тип, который restore не сможет собрать заново по виду
+class Hermit: public NPC {
+    public:
+        Hermit() : NPC("Отшельник", 1, 1) {}
+        std::string get_type() const override { return "hermit"; }
+};
+
+TEST(WorldSnapshotTest, RejectsTypesRestoreCannotRebuild) {
+    NPC_array arr;
+    arr.add_NPC(std::make_unique<squirrel>("Белка", 1, 2));
+    arr.add_NPC(std::make_unique<NPC>("Житель", 3, 4));
+    WorldSnapshot snap = arr.snapshot();
+    arr.add_NPC(std::make_unique<Hermit>());
+    arr.get_npcs()[0]->set_x(50);
+    ASSERT_THROW(arr.snapshot(), std::logic_error);
+    // неудачный снимок ничего не портит
+    arr.remove_npc("Отшельник");
+    WorldSnapshot moved = arr.snapshot();
+    arr.restore(snap);
+    ASSERT_EQ(arr.get_npcs()[0]->get_x_cord(), 1);
+    arr.restore(moved);
+    ASSERT_EQ(arr.get_npcs()[0]->get_x_cord(), 50);
+    ASSERT_EQ(arr.get_npcs()[1]->get_type(), "NPC");
+}
+
+TEST(WorldSnapshotTest, StillNPCsStayShared) {
+    NPC_array arr;
+    fill_random_world(arr, 2 * WorldSnapshot::CHUNK_SIZE, 37);
+    MovementStage stage(3);
+    stage.set_speed(NPCKind::werewolf, 0);
+    stage.set_speed(NPCKind::druid, 0);
+    stage.set_speed(NPCKind::squirrel, 0);
+    WorldSnapshot before = arr.snapshot();
+    stage.step(arr);
+    ASSERT_EQ(arr.snapshot().get_chunks(), before.get_chunks());
+}
+
+TEST(WorldSnapshotTest, RejectsSnapshotOfAnotherArray) {
+    NPC_array arr, other;
+    fill_random_world(arr, 100, 1);
+    WorldSnapshot snap = arr.snapshot();
+    ASSERT_THROW(other.restore(snap), std::logic_error);
+    arr.clear();
+    ASSERT_THROW(arr.restore(snap), std::logic_error);
+}
+
+// ==================== Тесты движения ====================
+
+TEST(MovementTest, KernelsMatchScalar) {
+    std::mt19937 gen(8);
+    std::uniform_real_distribution<double> coord(-20.0, 520.0);
+    std::uniform_real_distribution<double> dir(-1.0, 1.0);
+    const size_t n = 1003;
+    std::vector<double> x(n), y(n), vx(n), vy(n), steps(n);
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = coord(gen);
+        y[i] = coord(gen);
+        vx[i] = dir(gen);
+        vy[i] = dir(gen);
+        steps[i] = 30 * dir(gen);
+    }
+    x[5] = NAN;
+    auto x2 = x, y2 = y, vx2 = vx, vy2 = vy;
+    move_scalar(x.data(), y.data(), vx.data(), vy.data(), steps.data(), n, WORLD_SIZE);
+    select_move_kernel()(x2.data(), y2.data(), vx2.data(), vy2.data(), steps.data(), n, WORLD_SIZE);
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(std::memcmp(&x[i], &x2[i], sizeof(double)), 0) << i;
+        ASSERT_EQ(std::memcmp(&y[i], &y2[i], sizeof(double)), 0) << i;
+        ASSERT_EQ(vx[i], vx2[i]) << i;
+        ASSERT_EQ(vy[i], vy2[i]) << i;
+        ASSERT_TRUE(x[i] >= 0 && x[i] <= WORLD_SIZE);
+        ASSERT_TRUE(y[i] >= 0 && y[i] <= WORLD_SIZE);
+    }
+}
+
+TEST(MovementTest, BouncesOffBorder) {
+    NPC_array arr;
+    NPC& sq = arr.emplace_npc(NPCKind::squirrel, "Белка1", 499, 250);
+    NPC& dr = arr.emplace_npc(NPCKind::druid, "Друид1", 10, 10);
+    NPC& npc = arr.emplace_npc(NPCKind::npc, "Безымянный", 5, 5);
+    sq.set_velocity(1, 0);
+    dr.set_velocity(0, -1);
+    sq.mark_clean();
+    dr.mark_clean();
+    npc.mark_clean();
+
+    MovementStage stage(1);
+    stage.set_speed(NPCKind::squirrel, 3);
+    stage.step(arr);
+    ASSERT_EQ(sq.get_x_cord(), WORLD_SIZE);
+    ASSERT_EQ(sq.get_vx(), -1);
+    ASSERT_EQ(dr.get_y_cord(), 9);
+    ASSERT_TRUE(sq.is_dirty());
+    // у простого NPC скорость нулевая, он стоит на месте
+    ASSERT_EQ(npc.get_x_cord(), 5);
+    ASSERT_FALSE(npc.is_dirty());
+}
+
+TEST(MovementTest, SameSeedSameWorld) {
+    NPC_array a, b;
+    fill_random_world(a, 500, 4);
+    fill_random_world(b, 500, 4);
+    CombatVisitor first, second;
+    first.set_movement(std::make_unique<MovementStage>(77));
+    second.set_movement(std::make_unique<MovementStage>(77));
+    for (int round = 0; round < 5; ++round) {
+        first.do_combat(a, 5.0);
+        second.do_combat(b, 5.0);
+    }
+    ASSERT_EQ(dump(a), dump(b));
+}
+
+// ==================== Тесты SIMD-ядра ====================
+
+TEST(RangeKernelTest, MatchesScalar) {
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<double> coord(0.0, 500.0);
+    std::vector<double> xs(RANGE_BLOCK), ys(RANGE_BLOCK);
+    RangeKernel kernel = select_range_kernel();
+    for (int iter = 0; iter < 1000; ++iter) {
+        for (size_t k = 0; k < RANGE_BLOCK; ++k) {
+            xs[k] = coord(gen);
+            ys[k] = coord(gen);
+        }
+        // одна цель ровно на границе радиуса
+        xs[iter % RANGE_BLOCK] = 200.0;
+        ys[iter % RANGE_BLOCK] = 130.0;
+        for (size_t count : {RANGE_BLOCK, size_t(5)}) {
+            ASSERT_EQ(kernel(100.0, 130.0, xs.data(), ys.data(), count, 100.0 * 100.0),
+                      range_mask_scalar(100.0, 130.0, xs.data(), ys.data(), count, 100.0 * 100.0));
+        }
+    }
+}
+
+TEST(RangeKernelTest, BoundaryIsInclusive) {
+    double xs[RANGE_BLOCK] = {10, 11, 0, 0, 3, 0, 0, 0};
+    double ys[RANGE_BLOCK] = {0, 0, 10, 10.5, 4, 0, 0, 0};
+    ASSERT_EQ(select_range_kernel()(0, 0, xs, ys, RANGE_BLOCK, 100.0), 0b11110101u);
+}
+
+// ==================== Тесты счётчиков ====================
+
+#if NPC_STATS
+TEST(StatsTest, CombatCounters) {
+    NPC_array arr;
+    fill_random_world(arr, 2000, 11);
+    size_t before = arr.get_size();
+    CombatVisitor combat(2);
+    combat.add_observer(std::make_unique<FileLogger>("stats_test.log"));
+    combat.add_observer(std::make_unique<StatsObserver>(nullptr));
+    combat.do_combat(arr, 10.0);
+    const CombatStats& stats = combat.get_stats();
+
+    ASSERT_EQ(stats.round, 1);
+    ASSERT_EQ(stats.npcs, before);
+    ASSERT_EQ(stats.kills, before - arr.get_size());
+    ASSERT_EQ(stats.events, stats.kills);
+    ASSERT_GE(stats.pairs_tested, stats.pairs_in_range);
+    ASSERT_GE(stats.pairs_in_range, stats.kills);
+    ASSERT_GT(stats.total_ns, 0);
+    ASSERT_GE(stats.total_ns, stats.scan_ns + stats.fight_ns + stats.notify_ns);
+
+    // Логгер насчитал ровно столько байт, сколько записал в файл
+    std::ifstream log("stats_test.log", std::ios::binary | std::ios::ate);
+    ASSERT_EQ(stats.bytes_logged, static_cast<uint64_t>(log.tellg()));
+    log.close();
+    std::remove("stats_test.log");
+}
+
+TEST(StatsTest, IncrementalRoundTestsFewerPairs) {
+    NPC_array arr;
+    fill_random_world(arr, 2000, 12);
+    CombatVisitor combat;
+    combat.set_incremental(true);
+    combat.do_combat(arr, 10.0);
+    uint64_t full = combat.get_stats().pairs_tested;
+    arr.get_npcs()[0]->set_x(250);
+    combat.do_combat(arr, 10.0);
+
+    ASSERT_EQ(combat.get_stats().round, 2);
+    ASSERT_LT(combat.get_stats().pairs_tested, full);
+}
+
+TEST(StatsTest, LoaderCounters) {
+    FILE* file = fopen("stats_load.txt", "w");
+    fprintf(file, "squirrel a 1 1\nwerewolf b 600 1\ndragon c 2 2\ndruid d 3 3\n");
+    fclose(file);
+    for (auto load : {NPCFactory::load_from_file_c_style, NPCFactory::load_from_file_mmap}) {
+        NPC_array arr;
+        testing::internal::CaptureStderr();
+        load("stats_load.txt", arr);
+        testing::internal::GetCapturedStderr();
+        const LoadStats& stats = NPCFactory::get_load_stats();
+        ASSERT_EQ(stats.bytes, 57);
+        ASSERT_EQ(stats.records, 4);
+        ASSERT_EQ(stats.loaded, 2);
+        ASSERT_EQ(stats.rejected, 2);
+    }
+    NPC_array arr;
+    testing::internal::CaptureStderr();
+    NPCFactory::load_from_file_parallel("stats_load.txt", arr, 2, 16);
+    testing::internal::GetCapturedStderr();
+    ASSERT_EQ(NPCFactory::get_load_stats().records, 4);
+    ASSERT_EQ(NPCFactory::get_load_stats().loaded, 2);
+    std::remove("stats_load.txt");
+}
+#else
+TEST(StatsTest, DisabledStatsStayZero) {
+    NPC_array arr;
+    fill_random_world(arr, 500, 13);
+    CombatVisitor combat;
+    combat.do_combat(arr, 10.0);
+
+    // Без NPC_STATS счётчики не собираются
+    ASSERT_EQ(combat.get_stats().kills, 0);
+    ASSERT_EQ(combat.get_stats().total_ns, 0);
+    ASSERT_EQ(sizeof(PhaseTimer), 1);
+}
+#endif
+
 // ==================== Граничные случаи ====================
 
 TEST(EdgeCaseTest, CoordinatesAtBoundary) {